@@ -1,6 +1,10 @@
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <sstream>
 
 #include <flint.h>
@@ -15,6 +19,11 @@
 #include "arora-ge-ntru/keygen.hpp"
 #include "arora-ge-ntru/system.hpp"
 #include "arora-ge-ntru/recover.hpp"
+#include "arora-ge-ntru/tiled.hpp"
+#include "arora-ge-ntru/packed.hpp"
+#ifdef ARORA_GE_MPI
+#include "arora-ge-ntru/distributed.hpp"
+#endif
 #include "arora-ge-ntru/extras.hpp"
 #include "arora-ge-ntru/logging.hpp"
 
@@ -73,7 +82,7 @@ void keygen(argparse::ArgumentParser& program, NTRUKeyGen& ctx) {
   nmod_mat_clear(H_mat);
 }
 
-void system(argparse::ArgumentParser& program, NTRUKeyGen& ctx) {
+void system(argparse::ArgumentParser& program, NTRUKeyGen& ctx, int nthreads) {
   int n = ctx.degree();
   int q = ctx.q();
   int c = ctx.coeffs();
@@ -91,29 +100,82 @@ void system(argparse::ArgumentParser& program, NTRUKeyGen& ctx) {
   nmod_mat_init_from_stream(H_mat, q, file);
   
   int nkeys = nmod_mat_nrows(H_mat);
-  ulong nvars = num_variables(n, c);
+  bool fold = program["--fold"] == true;
+  ulong nvars = num_variables(n, c, fold);
+  if (program["--no-early-abort"] == false) {
+    int total = nkeys;
+    int epsilon = program.present<int>("--epsilon").value_or((int) nvars);
+    nkeys = num_keys(n, c, nkeys, epsilon, fold);
+    debug("Using ", nkeys, " of ", total, " keys.\n");
+  }
 
   int nrows = n*nkeys;
   debug("Building ", nrows, " x ", nvars,  " system.\n");
-  nmod_mat_t res;
-  nmod_mat_init(res, nrows, nvars, q);
-  arora_ge_system(res, H_mat, ctx);
-  nmod_mat_clear(H_mat);
-  
-  // Save system to file if output file specified, otherwise print to stdout
+
+  // Save system to file if output file specified, otherwise print to stdout.
+  // Rows are generated and written one key at a time so only an n x nvars
+  // block is ever held in memory.
+  std::ofstream out_file;
+  if (!out_fn.empty()) {
+    out_file.open(out_fn);
+  }
+  std::ostream& os = out_fn.empty() ? std::cout : out_file;
+
+  // With several threads, a batch of nthreads keys is built at once.
+  int batch = std::max(1, std::min(nthreads, nkeys));
+  SystemBuilder builder(ctx, fold);
+  nmod_mat_t block, keys, window;
+  nmod_mat_init(block, n*batch, nvars, q);
+  os << "[";
+  for (int i = 0; i < nkeys; i += batch) {
+    int b = std::min(batch, nkeys - i);
+    nmod_mat_window_init(keys, H_mat, i, 0, i + b, n);
+    nmod_mat_window_init(window, block, 0, 0, n*b, nvars);
+    arora_ge_system(window, keys, builder, nthreads);
+    nmod_mat_rows_to_stream(window, os);
+    nmod_mat_window_clear(window);
+    nmod_mat_window_clear(keys);
+  }
+  os << "]";
   if (out_fn.empty()) {
-    std::stringstream ss;
-    nmod_mat_to_stream(res, ss);
-    std::cout << ss.str() << '\n';
-  } else {
-    std::ofstream file;
-    file.open(out_fn);
-    nmod_mat_to_stream(res, file);
+    os << '\n';
   }
-  nmod_mat_clear(res);
+  nmod_mat_clear(block);
+  nmod_mat_clear(H_mat);
 }
 
-void recover(argparse::ArgumentParser& program, NTRUKeyGen& ctx) {
+// Read the system file straight into packed words of type T.
+template <typename T>
+PackedMatrix<T> read_packed(const std::string& in_fn, nmod_t mod) {
+  slong nrows, ncols;
+  std::ifstream file;
+  file.open(in_fn);
+  tiled_stream_shape(file, nrows, ncols);
+  file.close();
+
+  PackedMatrix<T> system(nrows, ncols, mod);
+  file.open(in_fn);
+  packed_from_stream(system, file);
+  return system;
+}
+
+// Recover the denominator from the system file, held in packed words.
+template <typename T>
+int recover_packed(nmod_mat_t den, const std::string& in_fn, 
+    NTRUKeyGen& ctx) {
+  PackedMatrix<T> system = read_packed<T>(in_fn, ctx.q_nmod());
+  return arora_ge_recover_packed(den, system, ctx);
+}
+
+// Initialize ker to the kernel of the system file, held in packed words.
+template <typename T>
+void nullspace_packed(nmod_mat_t ker, const std::string& in_fn, nmod_t mod) {
+  PackedMatrix<T> system = read_packed<T>(in_fn, mod);
+  arora_ge_recover_nullonly(ker, system);
+}
+
+void recover(argparse::ArgumentParser& program, NTRUKeyGen& ctx, 
+    int nthreads) {
   int n = ctx.degree();
   int q = ctx.q();
 
@@ -123,6 +185,124 @@ void recover(argparse::ArgumentParser& program, NTRUKeyGen& ctx) {
     out_fn = *out;
   }
 
+  // the checkpointed elimination works on the full system by row blocks
+  if (program.present("--checkpoint") && (program["--cyclic"] == true 
+        || program.present<int>("--compress"))) {
+    std::cerr << "--checkpoint cannot be combined with --cyclic or "
+      "--compress" << std::endl;
+    std::exit(1);
+  }
+
+  // the out-of-core solver only does a full recovery, by its own elimination
+  if (program.present("--out-of-core") && (program["--cyclic"] == true 
+        || program.present<int>("--compress") 
+        || program.present("--checkpoint") || program["--speculate"] == true
+        || program["--nullonly"] == true)) {
+    std::cerr << "--out-of-core cannot be combined with --cyclic, "
+      "--compress, --checkpoint, --speculate or --nullonly" << std::endl;
+    std::exit(1);
+  }
+
+  // the packed engine eliminates the whole system in one pass
+  if (program["--packed"] == true && (program["--cyclic"] == true 
+        || program.present<int>("--compress") 
+        || program.present("--checkpoint") || program["--speculate"] == true
+        || program.present("--out-of-core"))) {
+    std::cerr << "--packed cannot be combined with --cyclic, --compress, "
+      "--checkpoint, --speculate or --out-of-core" << std::endl;
+    std::exit(1);
+  }
+
+#ifdef ARORA_GE_MPI
+  // every rank reads the keys and builds the rows of its share of them
+  if (program["--mpi"] == true) {
+    int id;
+    MPI_Comm_rank(MPI_COMM_WORLD, &id);
+
+    debug("Reading key file.\n");
+    nmod_mat_t H_mat;
+    std::ifstream file;
+    file.open(in_fn);
+    nmod_mat_init_from_stream(H_mat, q, file);
+
+    nmod_mat_t den;
+    nmod_mat_init(den, 1, n, q);
+    debug("Attempting distributed key recovery.\n");
+    int ret = arora_ge_recover_distributed(den, H_mat, ctx, MPI_COMM_WORLD, 
+        nthreads);
+    if (ret == 0 && id == 0) {
+      debug("Saving key.\n");
+      std::ofstream out_file;
+      out_file.open(out_fn);
+      nmod_mat_to_stream(den, out_file);
+    }
+    nmod_mat_clear(den);
+    nmod_mat_clear(H_mat);
+    return;
+  }
+#endif
+
+  // with a directory for the out-of-core store, the system is read into it
+  // one tile at a time and never held in memory
+  if (auto dir = program.present("--out-of-core")) {
+    slong nrows, ncols;
+    std::ifstream file;
+    file.open(in_fn);
+    tiled_stream_shape(file, nrows, ncols);
+    file.close();
+
+    debug("Reading linear system file into ", *dir, ".\n");
+    slong memory = (slong) program.get<int>("--memory") << 20;
+    TiledMatrix system(*dir + "/system.tiles", nrows, ncols, 
+        tiled_rows_per_tile(ncols, memory), q);
+    file.open(in_fn);
+    tiled_from_stream(system, file);
+
+    nmod_mat_t den;
+    nmod_mat_init(den, 1, n, q);
+    debug("Attempting full key recovery.\n");
+    if (arora_ge_recover_tiled(den, system, ctx) == 0) {
+      debug("Saving key.\n");
+      std::ofstream out_file;
+      out_file.open(out_fn);
+      nmod_mat_to_stream(den, out_file);
+    }
+    nmod_mat_clear(den);
+    return;
+  }
+
+  if (program["--packed"] == true) {
+    debug("Reading linear system file into packed words.\n");
+    if (program["--nullonly"] == true && !out_fn.empty()) {
+      nmod_mat_t ker;
+      debug("Computing nullspace only.\n");
+      if (packed_fits_16(q)) {
+        nullspace_packed<uint16_t>(ker, in_fn, ctx.q_nmod());
+      } else {
+        nullspace_packed<uint32_t>(ker, in_fn, ctx.q_nmod());
+      }
+      std::ofstream file;
+      file.open(out_fn);
+      nmod_mat_to_stream(ker, file);
+      nmod_mat_clear(ker);
+      return;
+    }
+
+    nmod_mat_t den;
+    nmod_mat_init(den, 1, n, q);
+    int ret = packed_fits_16(q) 
+      ? recover_packed<uint16_t>(den, in_fn, ctx)
+      : recover_packed<uint32_t>(den, in_fn, ctx);
+    if (ret == 0) {
+      debug("Saving key.\n");
+      std::ofstream out_file;
+      out_file.open(out_fn);
+      nmod_mat_to_stream(den, out_file);
+    }
+    nmod_mat_clear(den);
+    return;
+  }
+
   debug("Reading linear system file.\n");
   nmod_mat_t system;
   std::ifstream file;
@@ -130,23 +310,45 @@ void recover(argparse::ArgumentParser& program, NTRUKeyGen& ctx) {
   nmod_mat_init_from_stream(system, q, file);
 
   if (program["--nullonly"] == true && !out_fn.empty()) {
-    int ncols = nmod_mat_ncols(system);
     nmod_mat_t ker;
-    nmod_mat_init(ker, ncols, n, q);
     
     debug("Computing nullspace only.\n");
-    arora_ge_recover_nullonly(ker, system);
+    arora_ge_recover_nullonly(ker, system, nthreads);
     std::ofstream file;
     file.open(out_fn);
     nmod_mat_to_stream(ker, file);
     nmod_mat_clear(ker);
   }
+  else if (auto path = program.present("--checkpoint")) {
+    nmod_mat_t den;
+    nmod_mat_init(den, 1, n, q);
+
+    debug("Attempting full key recovery with checkpoints in ", *path, ".\n");
+    Checkpoint checkpoint(*path, program.get<int>("--checkpoint-interval"), 
+        ctx.log_level());
+    int ret = arora_ge_recover_checkpointed(den, system, ctx, checkpoint, 
+        program["--resume"] == true, nthreads, 
+        program["--speculate"] == true);
+    if (ret == 0) {
+      debug("Saving key.\n");
+      std::ofstream file;
+      file.open(out_fn);
+      nmod_mat_to_stream(den, file);
+    }
+    std::remove(path->c_str());
+    nmod_mat_clear(den);
+  }
   else {
     nmod_mat_t den;
     nmod_mat_init(den, 1, n, q);
     
     debug("Attempting full key recovery.\n");
-    int ret = arora_ge_recover(den, system, ctx);
+    int compress = -1;
+    if (auto eps = program.present<int>("--compress")) {
+      compress = *eps;
+    }
+    int ret = arora_ge_recover(den, system, ctx, program["--cyclic"] == true, 
+        compress, nthreads, program["--speculate"] == true);
     if (ret == 0) {
       debug("Saving key.\n");
       std::ofstream file;
@@ -220,7 +422,7 @@ void verify(argparse::ArgumentParser& program, NTRUKeyGen& ctx) {
 }
 
 
-void all (argparse::ArgumentParser& program, NTRUKeyGen& ctx) {
+void all (argparse::ArgumentParser& program, NTRUKeyGen& ctx, int nthreads) {
   int n = ctx.degree();
   int q = ctx.q();
   int c = ctx.coeffs();
@@ -243,11 +445,48 @@ void all (argparse::ArgumentParser& program, NTRUKeyGen& ctx) {
   nmod_mat_to_stream(den, ss);
   std::cout << ss.str() << '\n';
 
-  // build system
-  ulong nvars = num_variables(n, c);
-  nmod_mat_t system;
-  nmod_mat_init(system, n*nkeys, nvars, q);
-  arora_ge_system(system, H_mat, ctx);
+  // build system, from only as many keys as needed unless told otherwise
+  bool fold = program["--fold"] == true;
+  ulong nvars = num_variables(n, c, fold);
+  int nkeys_used = nkeys;
+  if (program["--no-early-abort"] == false) {
+    int epsilon = program.present<int>("--epsilon").value_or((int) nvars);
+    nkeys_used = num_keys(n, c, nkeys, epsilon, fold);
+    debug("Using ", nkeys_used, " of ", nkeys, " keys.\n");
+  }
+  // the black box and tree solvers work from the keys and never form the 
+  // system
+  bool blackbox = program["--blackbox"] == true;
+  bool tree = program["--tree"] == true;
+  auto dir = program.present("--out-of-core");
+  nmod_mat_t system, keys;
+  nmod_mat_window_init(keys, H_mat, 0, 0, nkeys_used, n);
+  std::unique_ptr<TiledMatrix> tiled;
+  std::unique_ptr<PackedMatrix<uint16_t>> packed16;
+  std::unique_ptr<PackedMatrix<uint32_t>> packed32;
+  if (program["--packed"] == true) {
+    if (packed_fits_16(q)) {
+      packed16.reset(new PackedMatrix<uint16_t>(n*nkeys_used, nvars, 
+          ctx.q_nmod()));
+      arora_ge_system_packed(*packed16, keys, ctx, nthreads, fold);
+    } else {
+      packed32.reset(new PackedMatrix<uint32_t>(n*nkeys_used, nvars, 
+          ctx.q_nmod()));
+      arora_ge_system_packed(*packed32, keys, ctx, nthreads, fold);
+    }
+    nmod_mat_init(system, 0, nvars, q);
+  } else if (dir) {
+    slong memory = (slong) program.get<int>("--memory") << 20;
+    tiled.reset(new TiledMatrix(*dir + "/system.tiles", n*nkeys_used, nvars, 
+        tiled_rows_per_tile(nvars, memory), q));
+    arora_ge_system_tiled(*tiled, keys, ctx, fold);
+    nmod_mat_init(system, 0, nvars, q);
+  } else if (blackbox || tree) {
+    nmod_mat_init(system, 0, nvars, q);
+  } else {
+    nmod_mat_init(system, n*nkeys_used, nvars, q);
+    arora_ge_system(system, keys, ctx, nthreads, fold);
+  }
 
   if (0) {
     nmod_mat_to_stream(system, ss);
@@ -256,7 +495,24 @@ void all (argparse::ArgumentParser& program, NTRUKeyGen& ctx) {
   
   // solve linear system
   auto t0 = high_resolution_clock::now();  
-  arora_ge_recover(den_found, system, ctx);
+  if (packed16) {
+    arora_ge_recover_packed(den_found, *packed16, ctx);
+  } else if (packed32) {
+    arora_ge_recover_packed(den_found, *packed32, ctx);
+  } else if (tiled) {
+    arora_ge_recover_tiled(den_found, *tiled, ctx);
+  } else if (blackbox) {
+    arora_ge_recover_blackbox(den_found, keys, ctx, fold);
+  } else if (tree) {
+    arora_ge_recover_tree(den_found, keys, ctx, fold, nthreads);
+  } else {
+    int compress = -1;
+    if (auto eps = program.present<int>("--compress")) {
+      compress = *eps;
+    }
+    arora_ge_recover(den_found, system, ctx, program["--cyclic"] == true, 
+        compress, nthreads, program["--speculate"] == true);
+  }
   auto t1 = high_resolution_clock::now();
   auto duration = duration_cast<microseconds>(t1-t0);  
 
@@ -269,6 +525,7 @@ void all (argparse::ArgumentParser& program, NTRUKeyGen& ctx) {
   double rss = resident * page_size_kb;
   //double shared_mem = share * page_size_kb;
   nmod_mat_clear(system);
+  nmod_mat_window_clear(keys);
   
   if (0) {
     nmod_mat_to_stream(den_found, ss);
@@ -339,6 +596,10 @@ int main(int argc, char** argv) {
     .help("use 1 for NTRU: x^n - 1, 2 for NTRU2: x^n + 1, 3 for NTRUPrime: x^n - x - 1 or 4 for NTTRU: x^n - x^(n/2) + 1.")
     .default_value(1)
     .scan<'i', int>();
+  program.add_argument("-t", "--threads")
+    .default_value(1)
+    .help("number of threads used to build and solve the linear system")
+    .scan<'i', int>();
   program.add_argument("--verbose")
     .help("increase output verbosity")
     .flag();
@@ -368,6 +629,15 @@ int main(int argc, char** argv) {
     .help("input file of keys (output of keygen subcommand)");
   system_cmd.add_argument("-o", "--output")
     .help("optional output file");  
+  system_cmd.add_argument("--epsilon")
+    .help("number of rows beyond the number of variables to use when choosing the number of keys. Defaults to the number of variables; 1, the rule of the Sage implementation, can leave the system underdetermined, as small rings give repeated and rotated keys")
+    .scan<'i', int>();
+  system_cmd.add_argument("--no-early-abort")
+    .help("flag -- use all keys instead of only as many as needed")
+    .flag();
+  system_cmd.add_argument("--fold")
+    .help("flag -- fold pure powers x^c into x (x^c = x for binary and ternary keys)")
+    .flag();
   program.add_subparser(system_cmd);
   
   argparse::ArgumentParser recover_cmd("recover");
@@ -381,6 +651,38 @@ int main(int argc, char** argv) {
   recover_cmd.add_argument("--nullonly")
     .help("flag -- only output nullspace and then stop")
     .flag();
+  recover_cmd.add_argument("--cyclic")
+    .help("flag -- split the system along the rotations of rings 1 and 2 before solving")
+    .flag();
+  recover_cmd.add_argument("--compress")
+    .help("compress the system to this many rows beyond the number of variables before eliminating it")
+    .scan<'i', int>();
+  recover_cmd.add_argument("--speculate")
+    .help("flag -- reduce the next -t kernel blocks at once instead of one after another")
+    .flag();
+  recover_cmd.add_argument("--packed")
+    .help("flag -- store the system in 16 or 32-bit words, chosen from q")
+    .flag();
+#ifdef ARORA_GE_MPI
+  recover_cmd.add_argument("--mpi")
+    .help("flag -- read public keys instead of a system, and build and solve the system across the MPI ranks")
+    .flag();
+#endif
+  recover_cmd.add_argument("--checkpoint")
+    .help("file to save the progress of the recovery to, removed when it finishes");
+  recover_cmd.add_argument("--checkpoint-interval")
+    .default_value(600)
+    .help("seconds between checkpoints")
+    .scan<'i', int>();
+  recover_cmd.add_argument("--resume")
+    .help("flag -- continue from the file given by --checkpoint")
+    .flag();
+  recover_cmd.add_argument("--out-of-core")
+    .help("directory for a disk-backed copy of the system, which is then solved within --memory");
+  recover_cmd.add_argument("--memory")
+    .default_value(1024)
+    .help("memory budget in MB for the out-of-core solver")
+    .scan<'i', int>();
   program.add_subparser(recover_cmd);
 
   argparse::ArgumentParser verify_cmd("verify");
@@ -399,6 +701,39 @@ int main(int argc, char** argv) {
     .default_value(1)
     .help("number of keys to generate")
     .scan<'i', int>();
+  all_cmd.add_argument("--epsilon")
+    .help("number of rows beyond the number of variables to use when choosing the number of keys. Defaults to the number of variables; 1, the rule of the Sage implementation, can leave the system underdetermined, as small rings give repeated and rotated keys")
+    .scan<'i', int>();
+  all_cmd.add_argument("--no-early-abort")
+    .help("flag -- use all keys instead of only as many as needed")
+    .flag();
+  all_cmd.add_argument("--fold")
+    .help("flag -- fold pure powers x^c into x (x^c = x for binary and ternary keys)")
+    .flag();
+  all_cmd.add_argument("--cyclic")
+    .help("flag -- split the system along the rotations of rings 1 and 2 before solving")
+    .flag();
+  all_cmd.add_argument("--blackbox")
+    .help("flag -- find the kernel by Wiedemann's algorithm without forming the system")
+    .flag();
+  all_cmd.add_argument("--tree")
+    .help("flag -- merge the echelon forms of the keys' rows up a binary tree without forming the system")
+    .flag();
+  all_cmd.add_argument("--compress")
+    .help("compress the system to this many rows beyond the number of variables before eliminating it")
+    .scan<'i', int>();
+  all_cmd.add_argument("--speculate")
+    .help("flag -- reduce the next -t kernel blocks at once instead of one after another")
+    .flag();
+  all_cmd.add_argument("--packed")
+    .help("flag -- store the system in 16 or 32-bit words, chosen from q")
+    .flag();
+  all_cmd.add_argument("--out-of-core")
+    .help("directory for a disk-backed copy of the system, which is then solved within --memory");
+  all_cmd.add_argument("--memory")
+    .default_value(1024)
+    .help("memory budget in MB for the out-of-core solver")
+    .scan<'i', int>();
   program.add_subparser(all_cmd);
 
   try {
@@ -434,14 +769,28 @@ int main(int argc, char** argv) {
   int c = program.get<int>("--coeffs");
   int s = program.get<int>("--seed");
   int r = program.get<int>("--ring");
+  int t = program.get<int>("--threads");
 
   assert(n > 1);
   assert(q > 2);
   assert(c == 2 || c == 3);
   assert(r == 1 || r == 2 || r == 3 || r == 4);
+  assert(t > 0);
 
   int level = 0;
-  if (program["--verbose"] == true) {
+  bool verbose = program["--verbose"] == true;
+#ifdef ARORA_GE_MPI
+  // MPI is only started for recover --mpi, and finalized on every exit from
+  // then on; only the first rank logs
+  if (program.is_subcommand_used("recover") && recover_cmd["--mpi"] == true) {
+    MPI_Init(&argc, &argv);
+    std::atexit([]() { MPI_Finalize(); });
+    int mpi_rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &mpi_rank);
+    verbose = verbose && mpi_rank == 0;
+  }
+#endif
+  if (verbose) {
     level = 1;
     set_log_level(level);
   }
@@ -454,23 +803,24 @@ int main(int argc, char** argv) {
     "\n  coeffs = ", c,
     "\n  ring = ", r,
     "\n  seed = ", s,
+    "\n  threads = ", t,
     "\n"
   );
   
   if (program.is_subcommand_used("keygen")) {
     keygen(keygen_cmd, ctx);
   } else if (program.is_subcommand_used("system")) {
-    system(system_cmd, ctx);
+    system(system_cmd, ctx, t);
   } else if (program.is_subcommand_used("recover")) {
-    recover(recover_cmd, ctx);
+    recover(recover_cmd, ctx, t);
   } else if (program.is_subcommand_used("verify")) {
     verify(verify_cmd, ctx);
   } else if (program.is_subcommand_used("all")) {
-    all(all_cmd, ctx);
+    all(all_cmd, ctx, t);
   } else {
     std::cerr << program;
     std::exit(1);    
   }
-  
+
   return 0;
 }
@@ -0,0 +1,153 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <flint.h>
+#include <nmod_mat.h>
+
+#include "arora-ge-ntru/keygen.hpp"
+#include "arora-ge-ntru/system.hpp"
+#include "arora-ge-ntru/packed.hpp"
+#include "arora-ge-ntru/kernels.hpp"
+#include "arora-ge-ntru/extras.hpp"
+#include "arora-ge-ntru/echelon.hpp"
+#ifdef ARORA_GE_BLAS
+#include "arora-ge-ntru/blas.hpp"
+#endif
+
+using namespace std::chrono;
+
+// Time the kernel of the ring 1 system for one (n, q, coeffs), with FLINT's
+// nmod_mat_nullspace and with the packed delayed-reduction engine, and check
+// that both give the same basis.
+template <typename T>
+void bench(int n, int q, int c) {
+  NTRUKeyGen ctx(n, q, c, 1, 1, 0);
+  int nkeys = num_keys(n, c, n*n*n, 1);
+  ulong ncols = num_variables(n, c);
+
+  nmod_mat_t H_mat, system, kernel, packed_kernel;
+  nmod_mat_init(H_mat, nkeys, n, q);
+  ctx.generate(H_mat, nkeys);
+  nmod_mat_init(system, n*nkeys, ncols, q);
+  arora_ge_system(system, H_mat, ctx);
+
+  PackedMatrix<T> packed(n*nkeys, ncols, ctx.q_nmod());
+  packed.set_rows(0, system);
+
+  auto t0 = high_resolution_clock::now();
+  nmod_mat_init(kernel, ncols, ncols, q);
+  slong rank = nmod_mat_nullspace(kernel, system);
+  auto t1 = high_resolution_clock::now();
+  slong packed_rank;
+  packed_nullspace(packed_kernel, packed_rank, packed, ncols);
+  auto t2 = high_resolution_clock::now();
+
+  bool match = (rank == packed_rank);
+  for (ulong i = 0; match && i < ncols; i++) {
+    for (slong j = 0; j < rank; j++) {
+      match &= nmod_mat_entry(kernel, i, j) == nmod_mat_entry(packed_kernel, i, j);
+    }
+  }
+
+  double flint_s = duration_cast<microseconds>(t1 - t0).count()/1e6;
+  double packed_s = duration_cast<microseconds>(t2 - t1).count()/1e6;
+  printf("%4d %2d %11d %7ld %7lu %2lu %10.4f %10.4f %8.2f %s\n", n, c, q,
+      n*(long) nkeys, ncols, 8*sizeof(T), flint_s, packed_s,
+      flint_s/packed_s, match ? "yes" : "NO");
+
+  nmod_mat_clear(H_mat);
+  nmod_mat_clear(system);
+  nmod_mat_clear(kernel);
+  nmod_mat_clear(packed_kernel);
+}
+
+// Time the rref of the ring 1 binary system of degree n with
+// nmod_mat_rref_parallel on 1, 2, 4, ... threads, up to max_threads, and
+// report the speedup over one thread. With a BLAS, the single-threaded
+// nmod_mat_rref_blas is timed too, against the same one-thread base.
+void bench_threads(int n, int q, int max_threads) {
+  NTRUKeyGen ctx(n, q, 2, 1, 1, 0);
+  int nkeys = num_keys(n, 2, n*n*n, 1);
+  ulong ncols = num_variables(n, 2);
+
+  nmod_mat_t H_mat, system, copy;
+  nmod_mat_init(H_mat, nkeys, n, q);
+  ctx.generate(H_mat, nkeys);
+  nmod_mat_init(system, n*nkeys, ncols, q);
+  arora_ge_system(system, H_mat, ctx, max_threads);
+
+  std::vector<int> counts;
+  for (int t = 1; t < max_threads; t *= 2) {
+    counts.push_back(t);
+  }
+  counts.push_back(max_threads);
+
+  double base = 0;
+  auto report = [&](const char * engine, int t,
+      slong (*rref)(nmod_mat_t, int)) {
+    nmod_mat_init_set(copy, system);
+    auto t0 = high_resolution_clock::now();
+    slong r = rref(copy, t);
+    auto t1 = high_resolution_clock::now();
+    double s = duration_cast<microseconds>(t1 - t0).count()/1e6;
+    if (base == 0) {
+      base = s;
+    }
+    printf("%4d %11d %7ld %7lu %-6s %7d %10.4f %8.2f %4ld\n", n, q,
+        n*(long) nkeys, ncols, engine, t, s, base/s, ncols - r);
+    nmod_mat_clear(copy);
+  };
+  for (int t : counts) {
+    report("tiled", t, nmod_mat_rref_parallel);
+  }
+#ifdef ARORA_GE_BLAS
+  if (blas_fits(q)) {
+    report("blas", 1, [](nmod_mat_t A, int) { return nmod_mat_rref_blas(A); });
+  }
+#endif
+
+  nmod_mat_clear(H_mat);
+  nmod_mat_clear(system);
+}
+
+// With no arguments, compare the packed engine against FLINT. With 
+// "threads [n ...]", report the scaling of the parallel elimination on the 
+// systems of the given degrees, 64, 96 and 128 by default.
+int main(int argc, char ** argv) {
+  if (argc > 1 && strcmp(argv[1], "threads") == 0) {
+    std::vector<int> degrees = {64, 96, 128};
+    if (argc > 2) {
+      degrees.clear();
+      for (int i = 2; i < argc; i++) {
+        degrees.push_back(atoi(argv[i]));
+      }
+    }
+    int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    printf("#  n           q    rows    cols engine threads    time_s  speedup rank\n");
+    for (int n : degrees) {
+      bench_threads(n, 3329, max_threads);
+    }
+    return 0;
+  }
+
+  std::vector<std::pair<int, int>> sizes = {{16, 2}, {24, 2}, {32, 2},
+    {40, 2}, {12, 3}, {16, 3}};
+  std::vector<int> moduli = {97, 3329, 65537, 2147483647};
+
+  printf("# row kernel: %s\n", monomial_kernel_name());
+  printf("#  n  c           q    rows    cols  w    flint_s   packed_s  speedup match\n");
+  for (auto& size : sizes) {
+    for (int q : moduli) {
+      if (packed_fits_16(q)) {
+        bench<uint16_t>(size.first, q, size.second);
+      } else {
+        bench<uint32_t>(size.first, q, size.second);
+      }
+    }
+  }
+  return 0;
+}
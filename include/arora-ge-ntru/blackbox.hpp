@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include <flint.h>
+#include <nmod_mat.h>
+
+#include "keygen.hpp"
+
+// The linearized system of the keys in H_mat as a black box. Products with
+// the system and its transpose are evaluated one row at a time from the
+// multiplication matrices of the keys, so the system is never formed and
+// memory is O(nkeys*n + num_variables).
+class SystemOperator {
+  nmod_mat_struct * H_mat_;
+  const NTRUKeyGen& ctx_;
+  bool fold_;
+  slong nrows_;
+  slong ncols_;
+
+  // column of each linear and monomial variable in the (folded) system
+  std::vector<slong> column_;
+
+  void multiplication_matrix(nmod_mat_t mult, int key) const;
+
+  public:
+    SystemOperator(nmod_mat_t H_mat, const NTRUKeyGen& ctx, bool fold = false);
+
+    slong nrows() const { return nrows_; }
+    slong ncols() const { return ncols_; }
+
+    // y = S x, for y of length nrows and x of length ncols.
+    void apply(mp_limb_t * y, const mp_limb_t * x) const;
+
+    // y = S^T x, for y of length ncols and x of length nrows.
+    void apply_transpose(mp_limb_t * y, const mp_limb_t * x) const;
+};
+
+// Kernel of the linearized system of the keys in H_mat, by Wiedemann's
+// algorithm on the black box, with randomness from ctx.state. Random kernel
+// vectors are found until several in a row lie in the span of those found
+// so far, and for rings 1 and 2 the span is closed under the rotation. X must have num_variables(n, d, fold)
+// rows; at most ncols(X) kernel vectors are collected, so a return value of
+// ncols(X) means at least that many. Returns the dimension of the kernel,
+// with the basis nmod_mat_nullspace would return.
+slong arora_ge_nullspace_blackbox(nmod_mat_t X, nmod_mat_t H_mat,
+    NTRUKeyGen& ctx, bool fold = false);
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <flint.h>
+#include <nmod_mat.h>
+
+// Entries below 2^26 keep a product, plus an entry, exact in a double.
+inline bool blas_fits(mp_limb_t q) { return q <= (UWORD(1) << 26); }
+
+// Reduce A to its rref in place and return the rank, as nmod_mat_rref does,
+// for q with blas_fits(q). Blocks of rows are held as doubles; the update
+// of a block by the pivot rows found so far, and of those rows by the new
+// pivots of the block, is a BLAS dgemm, with entries reduced mod q after
+// each product and only as often inside one as exactness requires. The
+// pivot rows are kept in A itself and converted a chunk at a time for the
+// products, so the extra memory does not grow with the rank.
+slong nmod_mat_rref_blas(nmod_mat_t A);
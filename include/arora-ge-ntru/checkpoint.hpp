@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <flint.h>
+#include <nmod_mat.h>
+
+// State of a recover run, saved to a file at most every interval seconds so
+// that a killed run can be resumed. The file is replaced by a rename, so it
+// always holds a complete state.
+class Checkpoint {
+  std::string path_;
+  std::chrono::seconds interval_;
+  std::chrono::steady_clock::time_point last_;
+  // q, nrows, ncols and a hash of the entries of the system
+  uint64_t system_[4];
+
+  public:
+    enum Stage { NONE, ELIMINATION, REDUCTION };
+
+    Checkpoint(const std::string& path, int interval, int log_level = 0);
+
+    const std::string& path() const { return path_; }
+
+    // Tie the saved state to system, whose modulus, shape and hash are
+    // saved with it and checked against the file when it is loaded.
+    void set_system(const nmod_mat_t system);
+
+    // True once interval seconds have passed since the last save.
+    bool due() const;
+
+    // Stage of the saved state, NONE if there is no checkpoint file.
+    Stage stage() const;
+
+    // Elimination of the first next_row rows of an nrows x ncols system: E
+    // holds the rows of their rref, with pivots in the given columns.
+    void save_elimination(slong nrows, slong next_row,
+        const std::vector<slong>& pivots, nmod_mat_t E);
+    void load_elimination(slong nrows, slong& next_row,
+        std::vector<slong>& pivots, nmod_mat_t E);
+
+    // Kernel reduction about to add block i, which starts at row offset of
+    // kernel, to submat, for degree n. kernel and submat are initialized by
+    // the load.
+    void save_reduction(int i, ulong offset, nmod_mat_t kernel,
+        nmod_mat_t submat);
+    void load_reduction(int& i, ulong& offset, nmod_mat_t kernel,
+        nmod_mat_t submat, mp_limb_t q, int n);
+};
+
+// Kernel of the system by elimination in blocks of rows, saving the echelon
+// form reached to checkpoint when it is due. With resume, the elimination
+// continues from the saved state. Each block is reduced to rref with 
+// nthreads threads. Only the first ncols(X) kernel vectors are written to 
+// X, which must have ncols(system) rows. Returns the dimension of the 
+// kernel, with the basis nmod_mat_nullspace would return.
+slong arora_ge_nullspace_checkpointed(nmod_mat_t X, nmod_mat_t system,
+    Checkpoint& checkpoint, bool resume, int nthreads = 1);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <flint.h>
+#include <nmod_mat.h>
+
+#include "keygen.hpp"
+
+// Set res, which must have ncols(system) columns and at most as many rows
+// as system, to S system for a sparse random S: each row of the system is
+// added to weight distinct random rows of res with random nonzero
+// coefficients. This costs weight additions per row of the system.
+void arora_ge_compress_rows(nmod_mat_t res, nmod_mat_t system, int weight,
+    flint_rand_t state);
+
+// Probability that a uniform random sketch with nrows rows loses rank on a
+// system with ncols columns and a nonzero kernel, q^(r - nrows) / (q - 1)
+// for the largest possible rank r = ncols - 1. Sparse sketches are not
+// covered by the bound but behave alike in practice.
+double arora_ge_compress_bound(slong nrows, slong ncols, mp_limb_t q);
+
+// Kernel of the system computed from its compression to ncols + epsilon
+// rows, drawn from the state of ctx, in the form of
+// nmod_mat_nullspace_capped with nthreads threads. The kernel of the
+// compression contains that of the system, and is checked to be in it, so
+// the basis is the one nmod_mat_nullspace would return for the system. If
+// the check fails or the rank exceeds cap, the full system is eliminated
+// instead; it is left unchanged otherwise.
+int arora_ge_nullspace_compressed(nmod_mat_t X, slong& rank, nmod_mat_t system,
+    slong cap, int epsilon, NTRUKeyGen& ctx, int nthreads = 1);
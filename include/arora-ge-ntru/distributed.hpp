@@ -0,0 +1,25 @@
+#pragma once
+
+#include <mpi.h>
+
+#include <flint.h>
+#include <nmod_mat.h>
+
+#include "keygen.hpp"
+
+// Kernel of the system whose rows are split into bands across the ranks of
+// comm, band holding this rank's rows. The ranks take turns reducing their
+// band to echelon form and broadcasting its pivot rows, with which the later
+// ranks reduce their bands and the earlier ranks their pivot rows, so the
+// bands end up holding rref(system) between them. Only the first ncols(X)
+// kernel vectors are written to X, which must have ncols(band) rows, on
+// every rank. Returns the dimension of the kernel, with the basis
+// nmod_mat_nullspace would return.
+slong arora_ge_nullspace_distributed(nmod_mat_t X, nmod_mat_t band,
+    MPI_Comm comm);
+
+// Recover the denominator on every rank of comm. Each rank builds the rows
+// of its share of the keys in H_mat with nthreads threads, and the kernel is
+// found by arora_ge_nullspace_distributed.
+int arora_ge_recover_distributed(nmod_mat_t den, nmod_mat_t H_mat,
+    NTRUKeyGen& ctx, MPI_Comm comm, int nthreads = 1);
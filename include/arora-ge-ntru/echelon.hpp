@@ -0,0 +1,13 @@
+#pragma once
+
+#include <flint.h>
+#include <nmod_mat.h>
+
+// Reduce A to its rref in place with nthreads threads and return the rank,
+// as nmod_mat_rref does. The rows are split into tiles, which are
+// eliminated by the tasks of a TaskGraph: a panel task reduces a tile to
+// rref once the pivot rows of the tiles before it have been applied, an
+// update task applies the pivot rows of a tile to a later tile, and a back
+// substitution task clears the pivot columns of a tile from an earlier one.
+// Small matrices, and a single thread, use nmod_mat_rref.
+slong nmod_mat_rref_parallel(nmod_mat_t A, int nthreads);
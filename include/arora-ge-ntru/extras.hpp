@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <iostream>
+#include <string>
 #include <nmod_mat.h>
 
 void nmod_mat_from_nmod_poly(nmod_mat_t mat, nmod_poly_t poly);
@@ -10,11 +11,25 @@ void nmod_poly_from_nmod_mat(nmod_poly_t poly, nmod_mat_t mat);
 
 int power_product(nmod_mat_t row, std::vector<int> const &idx_vec);
 
+void monomial_products(mp_limb_t * res, const mp_limb_t * row, int n, int d, 
+    nmod_t mod);
+
 int factorial(int n, int k);
 
 ulong bin_uiui(ulong n, ulong k);
 
+std::vector<std::string> parse_line(std::string line);
+
 void nmod_mat_init_from_stream(nmod_mat_t mat, int q, std::istream& is);
 
 void nmod_mat_to_stream(nmod_mat_t mat, std::ostream& os);
 
+void nmod_mat_rows_to_stream(nmod_mat_t mat, std::ostream& os);
+
+void nmod_mat_nullspace_canonical(nmod_mat_t X, slong rank);
+
+bool nmod_mat_reduce_pivots(nmod_mat_t A, const std::vector<slong>& cols, 
+    nmod_mat_t B);
+
+int nmod_mat_nullspace_capped(nmod_mat_t X, slong& rank, nmod_mat_t A, 
+    slong cap, int nthreads = 1);
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+#include <flint.h>
+
+// Batched expansion of rows of a multiplication matrix into their degree d
+// monomials, i.e. the upper triangle of r r^T for d = 2 or the symmetric
+// 3-tensor of r for d = 3, each scaled by its multinomial coefficient and in
+// the column order of the linear system. Arithmetic is done in 32-bit lanes
+// with Barrett reduction, so the modulus must satisfy q < 2^16 so that 
+// products of reduced values fit in a lane. AVX-512 and AVX2 versions are 
+// selected at runtime when the CPU supports them, with a scalar fallback.
+bool monomial_kernel_supported(ulong q, int d);
+
+// Name of the instruction set used by the kernels ("avx512", "avx2" or 
+// "scalar").
+const char * monomial_kernel_name();
+
+// For each of the nrows rows of length n in rows (row-major, entries < q),
+// write its bin(n + d - 1, d) monomials to out[i].
+void monomial_kernel_rows(mp_limb_t * const * out, const uint32_t * rows, 
+    slong nrows, int n, int d, uint32_t q);
+
+// Row update for elimination with delayed reduction: acc[i] += c v[i] for 
+// 0 <= i < len, with c < 2^32, in 64-bit lanes and without reduction. The 
+// caller reduces acc before it can overflow. Selected like the monomial 
+// kernel.
+void row_kernel_addmul(uint64_t * acc, const uint16_t * v, slong len, 
+    uint32_t c);
+void row_kernel_addmul(uint64_t * acc, const uint32_t * v, slong len, 
+    uint32_t c);
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <flint.h>
+
+// Table of all monomials of degree d in n variables, in the order of the
+// non-linear columns of the linear system: index tuples 
+// 0 <= c_0 <= ... <= c_{d-1} < n in lexicographic order. The indices are
+// stored contiguously, d per monomial, alongside the number of repeated 
+// indices of each monomial (which determines its multinomial coefficient).
+class MonomialTable {
+  int n_;
+  int d_;
+  ulong size_;
+
+  std::vector<uint16_t> idx_;
+  std::vector<uint8_t> unique_;
+
+  // bins_[x*(d+1) + k] = binomial(x, k) for x < n + d
+  std::vector<ulong> bins_;
+
+  public:
+    MonomialTable(int n, int d);
+
+    int n() const { return n_; }
+    int d() const { return d_; }
+    ulong size() const { return size_; }
+
+    // Indices of the k-th monomial.
+    const uint16_t * unrank(ulong k) const { return &idx_[k*d_]; }
+
+    // Number of repeated indices of the k-th monomial.
+    int unique(ulong k) const { return unique_[k]; }
+
+    // Position of the monomial with the given (sorted) indices, for T int
+    // or uint16_t.
+    template <typename T>
+    ulong rank(const T * tuple) const;
+
+    // Column of the monomial in the linear system, after the n linear columns.
+    ulong column(const int * tuple) const { return n_ + rank(tuple); }
+
+    // Column of the k-th monomial in the linear system. With fold, the pure
+    // power x_a^d is merged into linear column a and the other monomials 
+    // move down by the a + 1 pure powers before them.
+    ulong column(ulong k, bool fold) const;
+
+    // Action of the rotation c -> c + 1 (mod n) of the variables on the 
+    // monomials, as a gather map: if row' is the next rotation of row (row 
+    // j + 1 of a cyclic multiplication matrix, whose entry c is entry c - 1 of
+    // row j), monomial k of row' is monomial map[k] of row. In the 
+    // negacyclic case entry 0 also changes sign, so the monomial is negated 
+    // when negate[k] is set.
+    void rotation(std::vector<uint32_t>& map, std::vector<uint8_t>& negate, 
+        bool negacyclic) const;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <vector>
+
+#include <flint.h>
+#include <nmod.h>
+#include <nmod_mat.h>
+
+#include "keygen.hpp"
+
+// Matrix over Z/qZ stored row-major in words of type T, uint16_t when
+// packed_fits_16(q) and uint32_t otherwise, instead of the 64-bit limbs of
+// nmod_mat_t.
+template <typename T>
+class PackedMatrix {
+  slong nrows_;
+  slong ncols_;
+  nmod_t mod_;
+  std::vector<T> entries_;
+
+  public:
+    PackedMatrix(slong nrows, slong ncols, nmod_t mod)
+      : nrows_(nrows), ncols_(ncols), mod_(mod), entries_(nrows*ncols, 0) {
+      assert(mod.n - 1 <= std::numeric_limits<T>::max());
+    }
+
+    slong nrows() const { return nrows_; }
+    slong ncols() const { return ncols_; }
+    nmod_t mod() const { return mod_; }
+
+    T * row(slong i) { return &entries_[i*ncols_]; }
+    const T * row(slong i) const { return &entries_[i*ncols_]; }
+
+    // Copy mat to the rows starting at row start.
+    void set_rows(slong start, nmod_mat_t mat) {
+      assert(nmod_mat_ncols(mat) == ncols_);
+      for (slong i = 0; i < nmod_mat_nrows(mat); i++) {
+        T * r = this->row(start + i);
+        for (slong j = 0; j < ncols_; j++) {
+          r[j] = nmod_mat_entry(mat, i, j);
+        }
+      }
+    }
+};
+
+inline bool packed_fits_16(mp_limb_t q) { return q - 1 <= UINT16_MAX; }
+
+// Read a matrix written by nmod_mat_to_stream into res.
+template <typename T>
+void packed_from_stream(PackedMatrix<T>& res, std::istream& is);
+
+// Build the linearized system into res, nthreads keys at a time. res must
+// have n*nrows(H_mat) rows and num_variables(n, d, fold) columns.
+template <typename T>
+void arora_ge_system_packed(PackedMatrix<T>& res, nmod_mat_t H_mat,
+    const NTRUKeyGen& keygen, int nthreads = 1, bool fold = false);
+
+// Reduce A in place, row by row, to its reduced row echelon form: row
+// rows[i] of A becomes the row with its pivot in column pivots[i] and the
+// other rows become zero. Products are accumulated in 64 bits and reduced
+// only when the next one could overflow, so q must be below 2^32. Returns 
+// the rank.
+template <typename T>
+slong packed_rref(PackedMatrix<T>& A, std::vector<slong>& rows,
+    std::vector<slong>& pivots);
+
+// Kernel of A, which is overwritten by packed_rref, in the basis 
+// nmod_mat_nullspace would return. As with nmod_mat_nullspace_capped, X is 
+// initialized to ncols(A) x rank, or with no columns and 1 returned if the 
+// rank exceeds cap.
+template <typename T>
+int packed_nullspace(nmod_mat_t X, slong& rank, PackedMatrix<T>& A, 
+    slong cap);
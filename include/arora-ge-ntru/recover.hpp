@@ -3,7 +3,65 @@
 
 #include <nmod_mat.h>
 #include "keygen.hpp"
+#include "tiled.hpp"
+#include "packed.hpp"
+#include "checkpoint.hpp"
 
-int arora_ge_recover(nmod_mat_t den, nmod_mat_t system, NTRUKeyGen& ctx);
+// Recover the denominator from the system, which is reduced in place. With
+// cyclic, the kernel of a ring 1 or 2 system is found with 
+// arora_ge_nullspace_cyclic. Otherwise, with compress >= 0, the system is 
+// first compressed to ncols + compress rows by arora_ge_nullspace_compressed.
+// The elimination and the kernel reduction use nmod_mat_rref_parallel with 
+// nthreads threads, or with speculate, the kernel reduction evaluates 
+// nthreads blocks at once as arora_ge_recover_kernel does.
+int arora_ge_recover(nmod_mat_t den, nmod_mat_t system, NTRUKeyGen& ctx, 
+    bool cyclic = false, int compress = -1, int nthreads = 1, 
+    bool speculate = false);
 
-void arora_ge_recover_nullonly(nmod_mat_t ker, nmod_mat_t system);
+// Recover the denominator without forming the system, from the kernel 
+// computed by arora_ge_nullspace_blackbox for the keys in H_mat.
+int arora_ge_recover_blackbox(nmod_mat_t den, nmod_mat_t H_mat, 
+    NTRUKeyGen& ctx, bool fold = false);
+
+// Recover the denominator without forming the system, from the kernel 
+// computed by arora_ge_nullspace_tree for the keys in H_mat on nthreads 
+// threads.
+int arora_ge_recover_tree(nmod_mat_t den, nmod_mat_t H_mat, NTRUKeyGen& ctx,
+    bool fold = false, int nthreads = 1);
+
+// Recover the denominator from a system stored on disk, using the 
+// out-of-core elimination of arora_ge_nullspace_tiled.
+int arora_ge_recover_tiled(nmod_mat_t den, TiledMatrix& system, 
+    NTRUKeyGen& ctx);
+
+// Recover the denominator from a packed system, which is overwritten by 
+// packed_nullspace.
+template <typename T>
+int arora_ge_recover_packed(nmod_mat_t den, PackedMatrix<T>& system, 
+    NTRUKeyGen& ctx);
+
+// Recover the denominator from the system, saving the state of the 
+// elimination and of the kernel reduction to checkpoint as they go. With 
+// resume, the run continues from the saved state with the same result; a 
+// state saved for another system is rejected. nthreads and speculate are 
+// as for arora_ge_recover.
+int arora_ge_recover_checkpointed(nmod_mat_t den, nmod_mat_t system, 
+    NTRUKeyGen& ctx, Checkpoint& checkpoint, bool resume = false, 
+    int nthreads = 1, bool speculate = false);
+
+// Recover the denominator from the first rank columns of initial_kernel, a
+// basis of the kernel of the system as returned by nmod_mat_nullspace. The
+// kernel reduction is saved to checkpoint, if given, when it is due, and 
+// runs on nthreads threads. With speculate, the next nthreads kernel blocks 
+// are reduced by the rows kept so far at once, one per thread, and then 
+// taken in order with the same result as one at a time.
+int arora_ge_recover_kernel(nmod_mat_t den, nmod_mat_t initial_kernel, 
+    slong rank, NTRUKeyGen& ctx, Checkpoint * checkpoint = nullptr, 
+    int nthreads = 1, bool speculate = false);
+
+// Initialize ker to a basis of the kernel of the system, which is reduced 
+// in place with nthreads threads, with one column per kernel vector.
+int arora_ge_recover_nullonly(nmod_mat_t ker, nmod_mat_t system, 
+    int nthreads = 1);
+template <typename T>
+int arora_ge_recover_nullonly(nmod_mat_t ker, PackedMatrix<T>& system);
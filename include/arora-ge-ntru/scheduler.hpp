@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Tasks with dependencies, run by a pool of threads with work stealing.
+// Each thread keeps a deque of ready tasks: it runs the newest task of its
+// own deque and, when that is empty, steals the oldest task of another. A
+// task becomes ready, on the deque of the thread that finished its last
+// dependency, once all the tasks it depends on have finished.
+class TaskGraph {
+  std::vector<std::function<void()>> tasks_;
+  std::vector<std::vector<size_t>> successors_;
+  std::vector<int> dependencies_;
+
+  public:
+    // Add a task and return its index.
+    size_t add(std::function<void()> task);
+
+    // Run task only after the task before has finished.
+    void depend(size_t task, size_t before);
+
+    size_t size() const { return tasks_.size(); }
+
+    // Run all tasks with nthreads threads, the calling thread included. If a
+    // task throws, no further tasks are started and the exception is
+    // rethrown once the running ones have finished.
+    void run(int nthreads);
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <nmod_mat.h>
+
+#include "keygen.hpp"
+
+// Kernel of a linearized system built by arora_ge_system for ring 1 or 2,
+// using its symmetry: each key's rows are one row rotated n times, and the
+// rotation acts on the columns as a signed permutation T with T^n = +-1.
+// Splitting the columns along the irreducible factors of x^n -+ 1 over F_q
+// gives one small system per factor, each with about num_variables / n
+// columns per degree of the factor. X must have ncols rows. Returns the
+// dimension of the kernel, with the basis nmod_mat_nullspace would return,
+// or -1 if the system does not have this symmetry. If the kernel does not 
+// fit in X, the factors are abandoned and some dimension above ncols(X) is 
+// returned.
+slong arora_ge_nullspace_cyclic(nmod_mat_t X, nmod_mat_t system,
+    const NTRUKeyGen& ctx);
+
+// Signed permutation T of the columns of a ring 1 or 2 system: entry c of
+// the next rotation of a row is entry perm[c] of the row, negated when 
+// negate[c] is set, and T e_c = +-e_{perm[c]} maps the kernel to itself. 
+// Returns false for other rings, or when T^n is not +-1.
+bool arora_ge_column_rotation(std::vector<slong>& perm,
+    std::vector<uint8_t>& negate, const NTRUKeyGen& ctx, bool fold = false);
@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <vector>
 
 #include <flint.h>
@@ -8,16 +9,62 @@
 
 #include "keygen.hpp"
 
-ulong num_variables(int n, int mode);
+ulong num_variables(int n, int mode, bool fold = false);
+
+int num_keys(int n, int mode, int nkeys, int epsilon, bool fold = false);
 
 std::vector<ulong> binomials(ulong n, ulong k);
 
-void arora_ge_system(nmod_mat_t res, nmod_mat_t H_mat, const NTRUKeyGen& keygen);
+// Gather map of the rotation action on the monomial columns (see 
+// MonomialTable::rotation). Empty if the rows of a multiplication matrix are
+// not rotations of each other.
+struct RotationGather {
+  std::vector<uint32_t> map;
+  std::vector<uint8_t> negate;
+};
+
+// The row builder for the ring and number of coefficients of keygen, picked
+// once with its rotation gather map, so that one SystemBuilder is shared by
+// all keys, blocks and threads of a run. With fold, the columns of the pure
+// powers x_i^d are merged into the linear columns using the field equation
+// of the secret's coefficients.
+class SystemBuilder {
+  const NTRUKeyGen& keygen_;
+  bool fold_;
+  RotationGather gather_;
+  void (*rows_)(nmod_mat_t, nmod_mat_t, int, int, int, const NTRUKeyGen&,
+      const RotationGather&, bool);
+
+  public:
+    SystemBuilder(const NTRUKeyGen& keygen, bool fold = false);
+
+    const NTRUKeyGen& keygen() const { return keygen_; }
+    bool fold() const { return fold_; }
+
+    // Set block to rows start, ..., end - 1 of the n rows contributed by the
+    // given key, so the system can be produced (and consumed) one key or one
+    // range of rotations at a time. block must have end - start rows and 
+    // num_variables(n, d, fold) columns.
+    void rows(nmod_mat_t block, nmod_mat_t H_mat, int key, int start, 
+        int end) const;
+};
+
+// Build the full linearized system in res, using nthreads threads. The 
+// output does not depend on the number of threads. With fold, res must have
+// num_variables(n, d, true) columns. The second form reuses builder, for 
+// callers that build the system a block of keys at a time.
+void arora_ge_system(nmod_mat_t res, nmod_mat_t H_mat, const NTRUKeyGen& keygen,
+    int nthreads = 1, bool fold = false);
+void arora_ge_system(nmod_mat_t res, nmod_mat_t H_mat, 
+    const SystemBuilder& builder, int nthreads = 1);
 
-void arora_ge_system_ntru_new(nmod_mat_t res, nmod_mat_t H_mat, const NTRUKeyGen& keygen);
+void multiplication_matrix(nmod_mat_t mat, nmod_poly_t h, const NTRUKeyGen& keygen);
 
-void arora_ge_system_ntru(nmod_mat_t res, nmod_mat_t H_mat, const NTRUKeyGen& keygen);
+void multiplication_matrix_ntru(nmod_mat_t mult, nmod_mat_t H_mat, int key, 
+    const NTRUKeyGen& keygen);
 
-void arora_ge_system_ntru2(nmod_mat_t res, nmod_mat_t H_mat, const NTRUKeyGen& keygen);
+void multiplication_matrix_ntru2(nmod_mat_t mult, nmod_mat_t H_mat, int key, 
+    const NTRUKeyGen& keygen);
 
-void arora_ge_system_generic(nmod_mat_t res, nmod_mat_t H_mat, const NTRUKeyGen& keygen);
+void multiplication_matrix_generic(nmod_mat_t mult, nmod_mat_t H_mat, int key, 
+    const NTRUKeyGen& keygen);
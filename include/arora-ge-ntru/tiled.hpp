@@ -0,0 +1,66 @@
+#pragma once
+
+#include <istream>
+#include <string>
+
+#include <flint.h>
+#include <nmod_mat.h>
+
+#include "keygen.hpp"
+
+// Matrix kept in a file, in tiles of rows_per_tile consecutive rows. A tile
+// is mapped into memory only while it is loaded or stored, so memory use is
+// bounded by the few tiles a caller holds at once. The file is removed when
+// the matrix is destroyed.
+class TiledMatrix {
+  std::string path_;
+  int fd_;
+  slong nrows_;
+  slong ncols_;
+  slong rows_per_tile_;
+  mp_limb_t q_;
+
+  public:
+    TiledMatrix(const std::string& path, slong nrows, slong ncols,
+        slong rows_per_tile, mp_limb_t q);
+    ~TiledMatrix();
+
+    TiledMatrix(const TiledMatrix&) = delete;
+    TiledMatrix& operator=(const TiledMatrix&) = delete;
+
+    slong nrows() const { return nrows_; }
+    slong ncols() const { return ncols_; }
+    slong rows_per_tile() const { return rows_per_tile_; }
+    mp_limb_t q() const { return q_; }
+    slong ntiles() const { return (nrows_ + rows_per_tile_ - 1)/rows_per_tile_; }
+
+    // Number of rows of tile t; only the last tile may be short.
+    slong tile_rows(slong t) const;
+
+    // Copy tile t to or from mat, which must have tile_rows(t) rows.
+    void load(nmod_mat_t mat, slong t) const;
+    void store(slong t, nmod_mat_t mat);
+};
+
+// Rows per tile such that arora_ge_nullspace_tiled, which holds four tiles
+// at a time, stays within the given number of bytes.
+slong tiled_rows_per_tile(slong ncols, slong memory);
+
+// Number of rows and columns of a matrix written by nmod_mat_to_stream.
+void tiled_stream_shape(std::istream& is, slong& nrows, slong& ncols);
+
+// Read a matrix written by nmod_mat_to_stream into res, one tile at a time.
+void tiled_from_stream(TiledMatrix& res, std::istream& is);
+
+// Build the linearized system into res one tile at a time. res must have
+// n*nrows(H_mat) rows and num_variables(n, d, fold) columns.
+void arora_ge_system_tiled(TiledMatrix& res, nmod_mat_t H_mat,
+    const NTRUKeyGen& keygen, bool fold = false);
+
+// Kernel of the system by out-of-core elimination. Each tile is reduced
+// against the tiles before it and then reduced to echelon form, and the
+// tiles before it are reduced by its new rows, so the file ends up holding
+// rref(system) in place. Only the first ncols(X) kernel vectors are written
+// to X, which must have ncols(system) rows. Returns the dimension of the
+// kernel, with the basis nmod_mat_nullspace would return.
+slong arora_ge_nullspace_tiled(nmod_mat_t X, TiledMatrix& system);
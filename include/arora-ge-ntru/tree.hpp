@@ -0,0 +1,16 @@
+#pragma once
+
+#include <flint.h>
+#include <nmod_mat.h>
+
+#include "keygen.hpp"
+
+// Kernel of the system of the keys in H_mat without forming it. The band of
+// n rows of each key is built and reduced to rref on its own, and the
+// echelon forms are merged pairwise up a binary tree, each merge dropping
+// the rows that depend on the others, so no echelon form holds more than
+// ncols rows. The bands and merges are tasks on nthreads threads. In the
+// form of nmod_mat_nullspace_capped, with the basis nmod_mat_nullspace
+// would return.
+int arora_ge_nullspace_tree(nmod_mat_t X, slong& rank, nmod_mat_t H_mat,
+    const NTRUKeyGen& ctx, slong cap, int nthreads = 1, bool fold = false);
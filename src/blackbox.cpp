@@ -0,0 +1,371 @@
+#include <cassert>
+#include <vector>
+
+#include <flint.h>
+#include <nmod.h>
+#include <nmod_mat.h>
+
+#include "blackbox.hpp"
+#include "system.hpp"
+#include "symmetry.hpp"
+#include "monomials.hpp"
+#include "extras.hpp"
+#include "logging.hpp"
+
+SystemOperator::SystemOperator(nmod_mat_t H_mat, const NTRUKeyGen& ctx,
+    bool fold) : H_mat_(H_mat), ctx_(ctx), fold_(fold) {
+  int n = ctx.degree();
+  int d = ctx.coeffs();
+  this->nrows_ = n*nmod_mat_nrows(H_mat);
+  this->ncols_ = num_variables(n, d, fold);
+
+  MonomialTable table(n, d);
+  this->column_.resize(n + table.size());
+  for (int c = 0; c < n; c++) {
+    this->column_[c] = c;
+  }
+  for (ulong k = 0; k < table.size(); k++) {
+    this->column_[n + k] = table.column(k, fold);
+  }
+}
+
+void SystemOperator::multiplication_matrix(nmod_mat_t mult, int key) const {
+  int r = this->ctx_.ring();
+  if (r == 1) {
+    multiplication_matrix_ntru(mult, this->H_mat_, key, this->ctx_);
+  } else if (r == 2) {
+    multiplication_matrix_ntru2(mult, this->H_mat_, key, this->ctx_);
+  } else {
+    multiplication_matrix_generic(mult, this->H_mat_, key, this->ctx_);
+  }
+}
+
+// Row j of a key is minus row j of its multiplication matrix followed by the
+// monomials of that row, which are expanded into a scratch row and
+// contracted with x.
+void SystemOperator::apply(mp_limb_t * y, const mp_limb_t * x) const {
+  int n = this->ctx_.degree();
+  int d = this->ctx_.coeffs();
+  nmod_t mod = this->ctx_.q_nmod();
+  slong nvars = this->column_.size();
+  slong nkeys = this->nrows_ / n;
+
+  // x in the unfolded columns
+  std::vector<mp_limb_t> xs(nvars), row(n), mono(nvars - n);
+  for (slong c = 0; c < nvars; c++) {
+    xs[c] = x[this->column_[c]];
+  }
+
+  nmod_mat_t mult;
+  nmod_mat_init(mult, n, n, mod.n);
+  for (slong key = 0; key < nkeys; key++) {
+    this->multiplication_matrix(mult, key);
+    for (int j = 0; j < n; j++) {
+      mp_limb_t acc = 0;
+      for (int c = 0; c < n; c++) {
+        row[c] = nmod_mat_entry(mult, j, c);
+        acc = nmod_sub(acc, nmod_mul(row[c], xs[c], mod), mod);
+      }
+      monomial_products(mono.data(), row.data(), n, d, mod);
+      for (slong k = 0; k < nvars - n; k++) {
+        acc = nmod_add(acc, nmod_mul(mono[k], xs[n + k], mod), mod);
+      }
+      y[key*n + j] = acc;
+    }
+  }
+  nmod_mat_clear(mult);
+}
+
+void SystemOperator::apply_transpose(mp_limb_t * y, const mp_limb_t * x)
+    const {
+  int n = this->ctx_.degree();
+  int d = this->ctx_.coeffs();
+  nmod_t mod = this->ctx_.q_nmod();
+  slong nvars = this->column_.size();
+  slong nkeys = this->nrows_ / n;
+
+  std::vector<mp_limb_t> row(n), mono(nvars - n);
+  for (slong c = 0; c < this->ncols_; c++) {
+    y[c] = 0;
+  }
+
+  nmod_mat_t mult;
+  nmod_mat_init(mult, n, n, mod.n);
+  for (slong key = 0; key < nkeys; key++) {
+    this->multiplication_matrix(mult, key);
+    for (int j = 0; j < n; j++) {
+      mp_limb_t a = x[key*n + j];
+      if (a == 0) {
+        continue;
+      }
+      for (int c = 0; c < n; c++) {
+        row[c] = nmod_mat_entry(mult, j, c);
+        y[c] = nmod_sub(y[c], nmod_mul(a, row[c], mod), mod);
+      }
+      monomial_products(mono.data(), row.data(), n, d, mod);
+      for (slong k = 0; k < nvars - n; k++) {
+        mp_limb_t& yk = y[this->column_[n + k]];
+        yk = nmod_add(yk, nmod_mul(a, mono[k], mod), mod);
+      }
+    }
+  }
+  nmod_mat_clear(mult);
+}
+
+namespace {
+
+// A = E S^T D S for random invertible diagonal D and E. It is square, its
+// kernel is that of S unless D is unlucky, and the random E keeps the
+// kernel of A from meeting its image, so A has no nilpotent part and
+// Wiedemann's kernel vectors are uniform in the kernel.
+class Preconditioned {
+  const SystemOperator& op_;
+  nmod_t mod_;
+  std::vector<mp_limb_t> D_;
+  std::vector<mp_limb_t> E_;
+  mutable std::vector<mp_limb_t> t_;
+
+  public:
+    Preconditioned(const SystemOperator& op, nmod_t mod)
+      : op_(op), mod_(mod), D_(op.nrows()), E_(op.ncols()), t_(op.nrows()) {}
+
+    void randomize(flint_rand_t state) {
+      for (mp_limb_t& x : this->D_) {
+        x = 1 + n_randint(state, this->mod_.n - 1);
+      }
+      for (mp_limb_t& x : this->E_) {
+        x = 1 + n_randint(state, this->mod_.n - 1);
+      }
+    }
+
+    void apply(mp_limb_t * y, const mp_limb_t * x) const {
+      this->op_.apply(this->t_.data(), x);
+      for (slong i = 0; i < this->op_.nrows(); i++) {
+        this->t_[i] = nmod_mul(this->t_[i], this->D_[i], this->mod_);
+      }
+      this->op_.apply_transpose(y, this->t_.data());
+      for (slong i = 0; i < this->op_.ncols(); i++) {
+        y[i] = nmod_mul(y[i], this->E_[i], this->mod_);
+      }
+    }
+};
+
+// Shortest C = 1 + c_1 x + ... + c_L x^L with
+// a_i + c_1 a_{i-1} + ... + c_L a_{i-L} = 0 for L <= i < len(a).
+// Returns L, C has L + 1 coefficients.
+slong berlekamp_massey(std::vector<mp_limb_t>& C,
+    const std::vector<mp_limb_t>& a, nmod_t mod) {
+  slong len = a.size();
+  C.assign(len + 1, 0);
+  std::vector<mp_limb_t> B(len + 1, 0), T;
+  C[0] = 1;
+  B[0] = 1;
+  slong L = 0, m = 1;
+  mp_limb_t b = 1;
+  for (slong i = 0; i < len; i++) {
+    mp_limb_t delta = a[i];
+    for (slong j = 1; j <= L; j++) {
+      delta = nmod_add(delta, nmod_mul(C[j], a[i-j], mod), mod);
+    }
+    if (delta == 0) {
+      m++;
+      continue;
+    }
+    mp_limb_t coeff = nmod_div(delta, b, mod);
+    bool grow = (2*L <= i);
+    if (grow) {
+      T = C;
+    }
+    for (slong j = 0; j + m <= len; j++) {
+      C[j + m] = nmod_sub(C[j + m], nmod_mul(coeff, B[j], mod), mod);
+    }
+    if (grow) {
+      L = i + 1 - L;
+      B = T;
+      b = delta;
+      m = 1;
+    } else {
+      m++;
+    }
+  }
+  C.resize(L + 1);
+  return L;
+}
+
+bool is_zero(const std::vector<mp_limb_t>& v) {
+  for (mp_limb_t x : v) {
+    if (x != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Find a random vector in the kernel of A. The minimal polynomial
+// x^t h(x), h(0) != 0, of A on a random b comes from the sequence
+// u^T A^i b, and then A^t h(A) b = 0 so the last nonzero A^i h(A) b is in
+// the kernel. Returns false if A looks nonsingular (t = 0), or if the
+// sequence gave only a factor of the minimal polynomial.
+bool wiedemann_kernel_vector(std::vector<mp_limb_t>& v,
+    const Preconditioned& A, slong N, nmod_t mod, flint_rand_t state,
+    bool& singular) {
+  std::vector<mp_limb_t> b(N), u(N), z(N), w(N);
+  for (slong i = 0; i < N; i++) {
+    b[i] = n_randint(state, mod.n);
+    u[i] = n_randint(state, mod.n);
+  }
+
+  std::vector<mp_limb_t> seq(2*N);
+  z = b;
+  for (slong i = 0; i < 2*N; i++) {
+    if (i > 0) {
+      A.apply(w.data(), z.data());
+      z.swap(w);
+    }
+    mp_limb_t x = 0;
+    for (slong j = 0; j < N; j++) {
+      x = nmod_add(x, nmod_mul(u[j], z[j], mod), mod);
+    }
+    seq[i] = x;
+  }
+
+  // minimal polynomial f_j = C_{L-j}, and h = f / x^t
+  std::vector<mp_limb_t> C;
+  slong L = berlekamp_massey(C, seq, mod);
+  slong t = 0;
+  while (t < L && C[L - t] == 0) {
+    t++;
+  }
+  singular = (t > 0);
+  if (!singular) {
+    return false;
+  }
+
+  // w = h(A) b by Horner's rule
+  for (slong j = 0; j < N; j++) {
+    w[j] = nmod_mul(C[0], b[j], mod);
+  }
+  for (slong k = L - t - 1; k >= 0; k--) {
+    A.apply(z.data(), w.data());
+    mp_limb_t h = C[L - t - k];
+    for (slong j = 0; j < N; j++) {
+      w[j] = nmod_add(z[j], nmod_mul(h, b[j], mod), mod);
+    }
+  }
+
+  for (slong i = 0; i <= t && !is_zero(w); i++) {
+    A.apply(z.data(), w.data());
+    if (is_zero(z)) {
+      v = w;
+      return true;
+    }
+    w.swap(z);
+  }
+  return false;
+}
+
+// Reduce v by the semi-echelon basis and add it if it is not in its span.
+bool insert_vector(std::vector<std::vector<mp_limb_t>>& basis,
+    std::vector<slong>& pivots, std::vector<mp_limb_t> v, nmod_t mod) {
+  slong N = v.size();
+  for (size_t i = 0; i < basis.size(); i++) {
+    mp_limb_t x = v[pivots[i]];
+    if (x == 0) {
+      continue;
+    }
+    for (slong j = 0; j < N; j++) {
+      v[j] = nmod_sub(v[j], nmod_mul(x, basis[i][j], mod), mod);
+    }
+  }
+  slong p = 0;
+  while (p < N && v[p] == 0) {
+    p++;
+  }
+  if (p == N) {
+    return false;
+  }
+  mp_limb_t inv = nmod_inv(v[p], mod);
+  for (slong j = 0; j < N; j++) {
+    v[j] = nmod_mul(v[j], inv, mod);
+  }
+  basis.push_back(v);
+  pivots.push_back(p);
+  return true;
+}
+
+}
+
+slong arora_ge_nullspace_blackbox(nmod_mat_t X, nmod_mat_t H_mat,
+    NTRUKeyGen& ctx, bool fold) {
+  nmod_t mod = ctx.q_nmod();
+  SystemOperator op(H_mat, ctx, fold);
+  slong N = op.ncols();
+  slong cap = nmod_mat_ncols(X);
+  assert(nmod_mat_nrows(X) == N);
+
+  // the kernel is closed under the rotation of rings 1 and 2
+  std::vector<slong> perm;
+  std::vector<uint8_t> negate;
+  bool rotates = arora_ge_column_rotation(perm, negate, ctx, fold);
+
+  Preconditioned A(op, mod);
+  A.randomize(ctx.state);
+
+  // Stop once several random kernel vectors in a row add nothing, or after
+  // repeated failures, which point to an unlucky preconditioner each time.
+  // A vector in the span, or a sequence whose minimal polynomial misses the
+  // factor x, turns up about once in q tries even while the kernel has more
+  // to give, so neither stops the search on its own.
+  std::vector<std::vector<mp_limb_t>> basis;
+  std::vector<slong> pivots;
+  std::vector<mp_limb_t> v(N), Sv(op.nrows());
+  int failures = 0, in_span = 0;
+  while ((slong) basis.size() < cap && failures < 8 && in_span < 4) {
+    bool singular;
+    if (!wiedemann_kernel_vector(v, A, N, mod, ctx.state, singular)) {
+      if (!singular) {
+        A.randomize(ctx.state);
+      }
+      failures++;
+      continue;
+    }
+    op.apply(Sv.data(), v.data());
+    if (!is_zero(Sv)) {
+      debug("Kernel vector of the preconditioned system is not in the "
+          "kernel, retrying.\n");
+      A.randomize(ctx.state);
+      failures++;
+      continue;
+    }
+    if (!insert_vector(basis, pivots, v, mod)) {
+      in_span++;
+      continue;
+    }
+    in_span = 0;
+    int found = basis.size();
+    debug("Kernel vectors found: ", found, "\n");
+
+    while (rotates && (slong) basis.size() < cap) {
+      std::vector<mp_limb_t> w(N);
+      for (slong c = 0; c < N; c++) {
+        w[perm[c]] = negate[c] ? nmod_neg(v[c], mod) : v[c];
+      }
+      v.swap(w);
+      if (!insert_vector(basis, pivots, v, mod)) {
+        break;
+      }
+    }
+  }
+
+  slong rank = basis.size();
+  nmod_mat_zero(X);
+  for (slong i = 0; i < rank; i++) {
+    for (slong j = 0; j < N; j++) {
+      nmod_mat_entry(X, j, i) = basis[i][j];
+    }
+  }
+  if (rank < cap) {
+    nmod_mat_nullspace_canonical(X, rank);
+  }
+  return rank;
+}
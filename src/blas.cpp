@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include <flint.h>
+#include <nmod.h>
+#include <nmod_mat.h>
+
+#include "blas.hpp"
+
+// the Fortran interface, which every BLAS library provides
+extern "C" void dgemm_(const char * transa, const char * transb,
+    const int * m, const int * n, const int * k, const double * alpha,
+    const double * a, const int * lda, const double * b, const int * ldb,
+    const double * beta, double * c, const int * ldc);
+
+namespace {
+
+// Row-major blocks of doubles with integer entries in [0, q) between
+// operations. Integers below 2^53 are exact, so x - q floor(x/q) is off by
+// at most one q.
+class DoubleMod {
+  double q_;
+  double qinv_;
+
+  public:
+    DoubleMod(mp_limb_t q) : q_(q), qinv_(1.0 / q) {}
+
+    double q() const { return q_; }
+
+    double reduce(double x) const {
+      x -= this->q_ * std::floor(x * this->qinv_);
+      if (x < 0) {
+        x += this->q_;
+      } else if (x >= this->q_) {
+        x -= this->q_;
+      }
+      return x;
+    }
+
+    // C -= A B for A m x k, B k x n and C m x n with leading dimensions lda,
+    // ldb and ldc. The product is split along k so that no partial sum
+    // reaches 2^53, with C reduced after each part.
+    void submul(double * C, int ldc, const double * A, int lda,
+        const double * B, int ldb, int m, int n, int k) const {
+      double q = this->q_;
+      double parts = std::floor((std::ldexp(1.0, 53) - q) / ((q - 1)*(q - 1)));
+      int chunk = (int) std::max(1.0, std::min((double) k, parts));
+      const double alpha = -1;
+      const double beta = 1;
+      for (int l = 0; l < k; l += chunk) {
+        int kk = std::min(chunk, k - l);
+        // row-major C -= A B is column-major C^T -= B^T A^T
+        dgemm_("N", "N", &n, &m, &kk, &alpha, B + (slong) l*ldb, &ldb, A + l,
+            &lda, &beta, C, &ldc);
+        for (int i = 0; i < m; i++) {
+          for (int j = 0; j < n; j++) {
+            C[(slong) i*ldc + j] = this->reduce(C[(slong) i*ldc + j]);
+          }
+        }
+      }
+    }
+};
+
+// Reduce the nrows x ncols block P to rref by row operations and return the
+// pivot columns of its first rows.
+std::vector<slong> block_rref(double * P, slong nrows, slong ncols,
+    const DoubleMod& dm, nmod_t mod) {
+  std::vector<slong> cols;
+  slong rank = 0;
+  for (slong c = 0; c < ncols && rank < nrows; c++) {
+    slong i = rank;
+    while (i < nrows && P[i*ncols + c] == 0) {
+      i++;
+    }
+    if (i == nrows) {
+      continue;
+    }
+    double * row = P + rank*ncols;
+    std::swap_ranges(row, row + ncols, P + i*ncols);
+
+    mp_limb_t inv = nmod_inv((mp_limb_t) row[c], mod);
+    for (slong j = c; j < ncols; j++) {
+      row[j] = nmod_mul((mp_limb_t) row[j], inv, mod);
+    }
+    for (slong l = 0; l < nrows; l++) {
+      double f = P[l*ncols + c];
+      if (l == rank || f == 0) {
+        continue;
+      }
+      for (slong j = c; j < ncols; j++) {
+        P[l*ncols + j] = dm.reduce(P[l*ncols + j] - f*row[j]);
+      }
+    }
+    cols.push_back(c);
+    rank++;
+  }
+  return cols;
+}
+
+// G = M[:, cols] for the first nrows rows of the ncols-wide M.
+void gather_columns(std::vector<double>& G, const double * M, slong nrows,
+    slong ncols, const std::vector<slong>& cols) {
+  slong r = cols.size();
+  G.resize(nrows*r);
+  for (slong i = 0; i < nrows; i++) {
+    for (slong l = 0; l < r; l++) {
+      G[i*r + l] = M[i*ncols + cols[l]];
+    }
+  }
+}
+
+// W = rows l0, ..., l0 + m - 1 of A as doubles.
+void load_rows(std::vector<double>& W, const nmod_mat_t A, slong l0, slong m) {
+  slong ncols = nmod_mat_ncols(A);
+  W.resize(m*ncols);
+  for (slong i = 0; i < m; i++) {
+    for (slong j = 0; j < ncols; j++) {
+      W[i*ncols + j] = nmod_mat_entry(A, l0 + i, j);
+    }
+  }
+}
+
+// Rows l0, ..., l0 + m - 1 of A from W, from column c on.
+void store_rows(nmod_mat_t A, const std::vector<double>& W, slong l0, slong m,
+    slong c) {
+  slong ncols = nmod_mat_ncols(A);
+  for (slong i = 0; i < m; i++) {
+    for (slong j = c; j < ncols; j++) {
+      nmod_mat_entry(A, l0 + i, j) = (mp_limb_t) W[i*ncols + j];
+    }
+  }
+}
+
+}
+
+slong nmod_mat_rref_blas(nmod_mat_t A) {
+  slong nrows = nmod_mat_nrows(A);
+  slong ncols = nmod_mat_ncols(A);
+  DoubleMod dm(A->mod.n);
+
+  // The pivot rows found so far are rows 0, ..., rank - 1 of A, with pivots
+  // in the given columns, and rows of A are added a block at a time. A block
+  // starts below the pivot rows, so it is read before pivot rows are written
+  // over it. The rows N of the last block, rows done, ..., rank - 1, are only
+  // applied to the rows before them along with the next block, so each pivot
+  // row is held as doubles once per block, with a chunk of rows at a time.
+  std::vector<double> P, N, G, H, W;
+  std::vector<slong> pivots, cols;
+  slong block = 32;
+  slong chunk = 8*block;
+  slong done = 0;
+
+  // reduce the block P of b rows by the pivot rows, and the rows before N
+  // by N
+  auto sweep = [&](slong b) {
+    slong first = done > 0 ? 
+      *std::min_element(pivots.begin(), pivots.begin() + done) : ncols;
+    if (b > 0) {
+      std::vector<slong> old(pivots.begin(), pivots.begin() + done);
+      gather_columns(G, P.data(), b, ncols, old);
+    }
+    for (slong l0 = 0; l0 < done; l0 += chunk) {
+      slong m = std::min(chunk, done - l0);
+      load_rows(W, A, l0, m);
+      if (b > 0) {
+        dm.submul(P.data() + first, ncols, G.data() + l0, done,
+            W.data() + first, ncols, b, ncols - first, m);
+      }
+      if (!cols.empty()) {
+        gather_columns(H, W.data(), m, ncols, cols);
+        dm.submul(W.data() + cols[0], ncols, H.data(), cols.size(),
+            N.data() + cols[0], ncols, m, ncols - cols[0], cols.size());
+        store_rows(A, W, l0, m, cols[0]);
+      }
+    }
+    // N is zero in the pivot columns before it, so the block stays zero there
+    if (b > 0 && !cols.empty()) {
+      gather_columns(H, P.data(), b, ncols, cols);
+      dm.submul(P.data() + cols[0], ncols, H.data(), cols.size(),
+          N.data() + cols[0], ncols, b, ncols - cols[0], cols.size());
+    }
+  };
+
+  for (slong start = 0; start < nrows && (slong) pivots.size() < ncols;
+      start += block) {
+    slong b = std::min(block, nrows - start);
+    load_rows(P, A, start, b);
+    sweep(b);
+
+    // the block is the next N
+    slong r = pivots.size();
+    cols = block_rref(P.data(), b, ncols, dm, A->mod);
+    slong rb = cols.size();
+    P.resize(rb*ncols);
+    N.swap(P);
+    store_rows(A, N, r, rb, 0);
+    pivots.insert(pivots.end(), cols.begin(), cols.end());
+    done = r;
+  }
+  sweep(0);
+
+  // order the pivot rows by pivot column, by swaps; at[p] is the pivot row
+  // now at position p and where[k] the position of pivot row k
+  slong rank = pivots.size();
+  std::vector<slong> order(rank), at(rank), where(rank);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+      [&](slong a, slong b) { return pivots[a] < pivots[b]; });
+  std::iota(at.begin(), at.end(), 0);
+  std::iota(where.begin(), where.end(), 0);
+  for (slong p = 0; p < rank; p++) {
+    slong s = where[order[p]];
+    if (s != p) {
+      nmod_mat_swap_rows(A, NULL, p, s);
+      std::swap(at[p], at[s]);
+      where[at[p]] = p;
+      where[at[s]] = s;
+    }
+  }
+  for (slong i = rank; i < nrows; i++) {
+    for (slong j = 0; j < ncols; j++) {
+      nmod_mat_entry(A, i, j) = 0;
+    }
+  }
+  return rank;
+}
@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <flint.h>
+#include <nmod.h>
+#include <nmod_mat.h>
+
+#include "checkpoint.hpp"
+#include "echelon.hpp"
+#include "extras.hpp"
+#include "logging.hpp"
+
+using namespace std::chrono;
+
+namespace {
+
+const char MAGIC[8] = {'A', 'G', 'N', 'T', 'R', 'U', 'C', 'P'};
+
+void write_word(std::ostream& os, uint64_t x) {
+  os.write((const char *) &x, sizeof(x));
+}
+
+uint64_t read_word(std::istream& is) {
+  uint64_t x;
+  if (!is.read((char *) &x, sizeof(x))) {
+    throw "Invalid checkpoint";
+  }
+  return x;
+}
+
+void write_mat(std::ostream& os, nmod_mat_t mat) {
+  slong nrows = nmod_mat_nrows(mat);
+  slong ncols = nmod_mat_ncols(mat);
+  write_word(os, nrows);
+  write_word(os, ncols);
+  std::vector<uint64_t> row(ncols);
+  for (slong i = 0; i < nrows; i++) {
+    for (slong j = 0; j < ncols; j++) {
+      row[j] = nmod_mat_entry(mat, i, j);
+    }
+    os.write((const char *) row.data(), ncols*sizeof(uint64_t));
+  }
+}
+
+void read_mat(std::istream& is, nmod_mat_t mat, mp_limb_t q) {
+  slong nrows = read_word(is);
+  slong ncols = read_word(is);
+  nmod_mat_init(mat, nrows, ncols, q);
+  std::vector<uint64_t> row(ncols);
+  for (slong i = 0; i < nrows; i++) {
+    if (!is.read((char *) row.data(), ncols*sizeof(uint64_t))) {
+      throw "Invalid checkpoint";
+    }
+    for (slong j = 0; j < ncols; j++) {
+      nmod_mat_entry(mat, i, j) = row[j];
+    }
+  }
+}
+
+void write_header(std::ostream& os, Checkpoint::Stage stage,
+    const uint64_t * system) {
+  os.write(MAGIC, 8);
+  write_word(os, stage);
+  for (int k = 0; k < 4; k++) {
+    write_word(os, system[k]);
+  }
+}
+
+// Open the checkpoint file and check its header, stage and system.
+void open_stage(std::ifstream& is, const std::string& path,
+    Checkpoint::Stage stage, const uint64_t * system) {
+  char magic[8];
+  is.open(path, std::ios::binary);
+  if (!is.read(magic, 8) || !std::equal(magic, magic + 8, MAGIC)
+      || read_word(is) != (uint64_t) stage) {
+    throw "Invalid checkpoint";
+  }
+  for (int k = 0; k < 4; k++) {
+    if (read_word(is) != system[k]) {
+      throw "Checkpoint does not match system";
+    }
+  }
+}
+
+}
+
+Checkpoint::Checkpoint(const std::string& path, int interval, int log_level) {
+  set_log_level(log_level);
+  this->path_ = path;
+  this->interval_ = seconds(interval);
+  this->last_ = steady_clock::now();
+  std::fill(this->system_, this->system_ + 4, 0);
+}
+
+void Checkpoint::set_system(const nmod_mat_t system) {
+  slong nrows = nmod_mat_nrows(system);
+  slong ncols = nmod_mat_ncols(system);
+  // FNV-1a over the entries
+  uint64_t hash = 14695981039346656037ULL;
+  for (slong i = 0; i < nrows; i++) {
+    for (slong j = 0; j < ncols; j++) {
+      hash = (hash ^ nmod_mat_entry(system, i, j)) * 1099511628211ULL;
+    }
+  }
+  this->system_[0] = system->mod.n;
+  this->system_[1] = nrows;
+  this->system_[2] = ncols;
+  this->system_[3] = hash;
+}
+
+bool Checkpoint::due() const {
+  return steady_clock::now() - this->last_ >= this->interval_;
+}
+
+Checkpoint::Stage Checkpoint::stage() const {
+  std::ifstream is(this->path_, std::ios::binary);
+  char magic[8];
+  if (!is.read(magic, 8) || !std::equal(magic, magic + 8, MAGIC)) {
+    return NONE;
+  }
+  return (Stage) read_word(is);
+}
+
+void Checkpoint::save_elimination(slong nrows, slong next_row,
+    const std::vector<slong>& pivots, nmod_mat_t E) {
+  std::string tmp = this->path_ + ".tmp";
+  std::ofstream os(tmp, std::ios::binary);
+  write_header(os, ELIMINATION, this->system_);
+  write_word(os, nrows);
+  write_word(os, next_row);
+  write_word(os, pivots.size());
+  for (slong c : pivots) {
+    write_word(os, c);
+  }
+  write_mat(os, E);
+  os.close();
+  if (!os || std::rename(tmp.c_str(), this->path_.c_str()) != 0) {
+    throw "Cannot write checkpoint";
+  }
+  this->last_ = steady_clock::now();
+  debug("Saved checkpoint at row ", next_row, ".\n");
+}
+
+void Checkpoint::load_elimination(slong nrows, slong& next_row,
+    std::vector<slong>& pivots, nmod_mat_t E) {
+  std::ifstream is;
+  open_stage(is, this->path_, ELIMINATION, this->system_);
+  if ((slong) read_word(is) != nrows) {
+    throw "Checkpoint does not match system";
+  }
+  next_row = read_word(is);
+  pivots.resize(read_word(is));
+  for (slong& c : pivots) {
+    c = read_word(is);
+  }
+
+  nmod_mat_t saved;
+  read_mat(is, saved, E->mod.n);
+  if (nmod_mat_ncols(saved) != nmod_mat_ncols(E)
+      || nmod_mat_nrows(saved) != (slong) pivots.size()) {
+    nmod_mat_clear(saved);
+    throw "Checkpoint does not match system";
+  }
+  nmod_mat_swap(E, saved);
+  nmod_mat_clear(saved);
+  debug("Resuming elimination at row ", next_row, ".\n");
+}
+
+void Checkpoint::save_reduction(int i, ulong offset, nmod_mat_t kernel,
+    nmod_mat_t submat) {
+  std::string tmp = this->path_ + ".tmp";
+  std::ofstream os(tmp, std::ios::binary);
+  write_header(os, REDUCTION, this->system_);
+  write_word(os, nmod_mat_ncols(kernel));
+  write_word(os, i);
+  write_word(os, offset);
+  write_mat(os, kernel);
+  write_mat(os, submat);
+  os.close();
+  if (!os || std::rename(tmp.c_str(), this->path_.c_str()) != 0) {
+    throw "Cannot write checkpoint";
+  }
+  this->last_ = steady_clock::now();
+  debug("Saved checkpoint at kernel block ", i, ".\n");
+}
+
+void Checkpoint::load_reduction(int& i, ulong& offset, nmod_mat_t kernel,
+    nmod_mat_t submat, mp_limb_t q, int n) {
+  std::ifstream is;
+  open_stage(is, this->path_, REDUCTION, this->system_);
+  if (read_word(is) != (uint64_t) n) {
+    throw "Checkpoint does not match system";
+  }
+  i = read_word(is);
+  offset = read_word(is);
+  read_mat(is, kernel, q);
+  read_mat(is, submat, q);
+  if (nmod_mat_ncols(kernel) != n || nmod_mat_ncols(submat) != n
+      || (uint64_t) nmod_mat_nrows(kernel) != this->system_[2]) {
+    nmod_mat_clear(kernel);
+    nmod_mat_clear(submat);
+    throw "Checkpoint does not match system";
+  }
+  debug("Resuming kernel reduction at block ", i, ".\n");
+}
+
+slong arora_ge_nullspace_checkpointed(nmod_mat_t X, nmod_mat_t system,
+    Checkpoint& checkpoint, bool resume, int nthreads) {
+  slong nrows = nmod_mat_nrows(system);
+  slong ncols = nmod_mat_ncols(system);
+  mp_limb_t q = system->mod.n;
+  assert(nmod_mat_nrows(X) == ncols);
+
+  // E holds the rref of the rows before next_row, whose pivots are in the
+  // given columns
+  slong next_row = 0;
+  std::vector<slong> pivots;
+  nmod_mat_t E, P, R, window, temp;
+  nmod_mat_init(E, 0, ncols, q);
+  if (resume && checkpoint.stage() == Checkpoint::ELIMINATION) {
+    checkpoint.load_elimination(nrows, next_row, pivots, E);
+  }
+
+  slong block = std::max((slong) 64, ncols/16);
+  while (next_row < nrows) {
+    slong end = std::min(next_row + block, nrows);
+    nmod_mat_window_init(window, system, next_row, 0, end, ncols);
+    nmod_mat_init_set(P, window);
+    nmod_mat_window_clear(window);
+    if (!pivots.empty()) {
+      nmod_mat_reduce_pivots(P, pivots, E);
+    }
+
+    slong rank = nmod_mat_rref_parallel(P, nthreads);
+    std::vector<slong> cols;
+    for (slong i = 0; i < rank; i++) {
+      slong c = 0;
+      while (nmod_mat_entry(P, i, c) == 0) {
+        c++;
+      }
+      cols.push_back(c);
+    }
+
+    // keep the earlier rows reduced at the new pivots
+    if (rank > 0) {
+      nmod_mat_window_init(R, P, 0, 0, rank, ncols);
+      if (!pivots.empty()) {
+        nmod_mat_reduce_pivots(E, cols, R);
+      }
+      nmod_mat_init(temp, nmod_mat_nrows(E) + rank, ncols, q);
+      nmod_mat_concat_vertical(temp, E, R);
+      nmod_mat_swap(E, temp);
+      nmod_mat_clear(temp);
+      nmod_mat_window_clear(R);
+      pivots.insert(pivots.end(), cols.begin(), cols.end());
+    }
+    nmod_mat_clear(P);
+
+    next_row = end;
+    debug("Eliminated ", next_row, " of ", nrows, " rows\n");
+    if (next_row < nrows && checkpoint.due()) {
+      checkpoint.save_elimination(nrows, next_row, pivots, E);
+    }
+  }
+
+  // one kernel vector for each non-pivot column, as in nmod_mat_nullspace
+  std::vector<uint8_t> is_pivot(ncols, 0);
+  for (slong c : pivots) {
+    is_pivot[c] = 1;
+  }
+  std::vector<slong> nonpivot;
+  for (slong c = 0; c < ncols; c++) {
+    if (!is_pivot[c]) {
+      nonpivot.push_back(c);
+    }
+  }
+  slong nullity = nonpivot.size();
+  slong m = std::min(nullity, (slong) nmod_mat_ncols(X));
+
+  nmod_mat_zero(X);
+  for (slong l = 0; l < m; l++) {
+    nmod_mat_entry(X, nonpivot[l], l) = 1;
+  }
+  for (size_t i = 0; i < pivots.size(); i++) {
+    for (slong l = 0; l < m; l++) {
+      nmod_mat_entry(X, pivots[i], l) =
+        nmod_neg(nmod_mat_entry(E, i, nonpivot[l]), X->mod);
+    }
+  }
+  nmod_mat_clear(E);
+  return nullity;
+}
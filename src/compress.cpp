@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include <flint.h>
+#include <nmod.h>
+#include <nmod_vec.h>
+#include <nmod_mat.h>
+
+#include "compress.hpp"
+#include "extras.hpp"
+#include "keygen.hpp"
+#include "logging.hpp"
+
+void arora_ge_compress_rows(nmod_mat_t res, nmod_mat_t system, int weight,
+    flint_rand_t state) {
+  slong nrows = nmod_mat_nrows(system);
+  slong ncols = nmod_mat_ncols(system);
+  slong m = nmod_mat_nrows(res);
+  nmod_t mod = system->mod;
+  assert(nmod_mat_ncols(res) == ncols && m <= nrows && m > 0);
+  weight = std::min((slong) weight, m);
+
+  std::vector<slong> targets(weight);
+  nmod_mat_zero(res);
+  for (slong i = 0; i < nrows; i++) {
+    for (int t = 0; t < weight; t++) {
+      slong k;
+      do {
+        k = n_randint(state, m);
+      } while (std::find(targets.begin(), targets.begin() + t, k)
+          != targets.begin() + t);
+      targets[t] = k;
+
+      mp_limb_t c = 1 + n_randint(state, mod.n - 1);
+      _nmod_vec_scalar_addmul_nmod(&nmod_mat_entry(res, k, 0),
+          &nmod_mat_entry(system, i, 0), ncols, c, mod);
+    }
+  }
+}
+
+double arora_ge_compress_bound(slong nrows, slong ncols, mp_limb_t q) {
+  return std::pow((double) q, (double) (ncols - 1 - nrows)) / (q - 1);
+}
+
+int arora_ge_nullspace_compressed(nmod_mat_t X, slong& rank, nmod_mat_t system,
+    slong cap, int epsilon, NTRUKeyGen& ctx, int nthreads) {
+  set_log_level(ctx.log_level());
+  slong nrows = nmod_mat_nrows(system);
+  slong ncols = nmod_mat_ncols(system);
+  mp_limb_t q = system->mod.n;
+  slong m = ncols + std::max(epsilon, 0);
+
+  if (m < nrows) {
+    double bound = arora_ge_compress_bound(m, ncols, q);
+    debug("Compressing ", nrows, " rows to ", m, ", failure probability ",
+        bound, ".\n");
+    nmod_mat_t sketch;
+    nmod_mat_init(sketch, m, ncols, q);
+    arora_ge_compress_rows(sketch, system, 3, ctx.state);
+    int status = nmod_mat_nullspace_capped(X, rank, sketch, cap, nthreads);
+    nmod_mat_clear(sketch);
+
+    // ker(system) is in ker(sketch), so they are equal if system X = 0
+    bool verified = false;
+    if (status == 0) {
+      nmod_mat_t check;
+      nmod_mat_init(check, nrows, rank, q);
+      nmod_mat_mul(check, system, X);
+      verified = nmod_mat_is_zero(check);
+      nmod_mat_clear(check);
+    }
+    if (verified) {
+      return 0;
+    }
+    debug("Compressed system lost rank, using full elimination.\n");
+    nmod_mat_clear(X);
+  }
+  return nmod_mat_nullspace_capped(X, rank, system, cap, nthreads);
+}
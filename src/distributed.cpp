@@ -0,0 +1,171 @@
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+#include <mpi.h>
+
+#include <flint.h>
+#include <nmod.h>
+#include <nmod_mat.h>
+
+#include "distributed.hpp"
+#include "recover.hpp"
+#include "system.hpp"
+#include "extras.hpp"
+#include "logging.hpp"
+
+static_assert(sizeof(mp_limb_t) == sizeof(uint64_t), "64-bit limbs");
+static_assert(sizeof(slong) == sizeof(int64_t), "64-bit slong");
+
+namespace {
+
+// Broadcast count limbs from root, in messages small enough for an int count.
+void broadcast_limbs(mp_limb_t * data, slong count, int root, MPI_Comm comm) {
+  for (slong i = 0; i < count; i += INT_MAX) {
+    int len = std::min(count - i, (slong) INT_MAX);
+    MPI_Bcast(data + i, len, MPI_UINT64_T, root, comm);
+  }
+}
+
+}
+
+slong arora_ge_nullspace_distributed(nmod_mat_t X, nmod_mat_t band,
+    MPI_Comm comm) {
+  int id, size;
+  MPI_Comm_rank(comm, &id);
+  MPI_Comm_size(comm, &size);
+  slong ncols = nmod_mat_ncols(band);
+  mp_limb_t q = band->mod.n;
+  assert(nmod_mat_nrows(X) == ncols);
+
+  // pivots[k] are the pivot columns of the rows of rank k, which are the
+  // first pivots[k].size() rows of its band after elimination
+  std::vector<std::vector<slong>> pivots(size);
+  std::vector<mp_limb_t> rows;
+  nmod_mat_t R, own;
+  for (int k = 0; k < size; k++) {
+    slong rank = 0;
+    if (id == k && nmod_mat_nrows(band) > 0) {
+      rank = nmod_mat_rref(band);
+      rows.resize(rank*ncols);
+      for (slong i = 0; i < rank; i++) {
+        slong c = 0;
+        while (nmod_mat_entry(band, i, c) == 0) {
+          c++;
+        }
+        pivots[k].push_back(c);
+        for (slong j = 0; j < ncols; j++) {
+          rows[i*ncols + j] = nmod_mat_entry(band, i, j);
+        }
+      }
+    }
+    MPI_Bcast(&rank, 1, MPI_INT64_T, k, comm);
+    if (rank == 0) {
+      continue;
+    }
+    pivots[k].resize(rank);
+    MPI_Bcast(pivots[k].data(), rank, MPI_INT64_T, k, comm);
+    rows.resize(rank*ncols);
+    broadcast_limbs(rows.data(), rank*ncols, k, comm);
+    if (id == k) {
+      continue;
+    }
+
+    // later ranks reduce their whole band, earlier ranks their pivot rows
+    slong nrows = id > k ? nmod_mat_nrows(band) : pivots[id].size();
+    if (nrows == 0) {
+      continue;
+    }
+    nmod_mat_init(R, rank, ncols, q);
+    for (slong i = 0; i < rank; i++) {
+      for (slong j = 0; j < ncols; j++) {
+        nmod_mat_entry(R, i, j) = rows[i*ncols + j];
+      }
+    }
+    nmod_mat_window_init(own, band, 0, 0, nrows, ncols);
+    nmod_mat_reduce_pivots(own, pivots[k], R);
+    nmod_mat_window_clear(own);
+    nmod_mat_clear(R);
+  }
+
+  slong total = 0;
+  for (int k = 0; k < size; k++) {
+    total += pivots[k].size();
+  }
+  debug("Distributed rank: ", total, "\n");
+
+  // one kernel vector for each non-pivot column, as in nmod_mat_nullspace;
+  // each rank fills in the rows of its pivots and the parts are summed
+  std::vector<uint8_t> is_pivot(ncols, 0);
+  for (int k = 0; k < size; k++) {
+    for (slong c : pivots[k]) {
+      is_pivot[c] = 1;
+    }
+  }
+  std::vector<slong> nonpivot;
+  for (slong c = 0; c < ncols; c++) {
+    if (!is_pivot[c]) {
+      nonpivot.push_back(c);
+    }
+  }
+  slong nullity = nonpivot.size();
+  slong m = std::min(nullity, (slong) nmod_mat_ncols(X));
+
+  std::vector<mp_limb_t> part(ncols*m, 0);
+  if (id == 0) {
+    for (slong l = 0; l < m; l++) {
+      part[nonpivot[l]*m + l] = 1;
+    }
+  }
+  for (size_t i = 0; i < pivots[id].size(); i++) {
+    for (slong l = 0; l < m; l++) {
+      part[pivots[id][i]*m + l] =
+        nmod_neg(nmod_mat_entry(band, i, nonpivot[l]), band->mod);
+    }
+  }
+  MPI_Allreduce(MPI_IN_PLACE, part.data(), ncols*m, MPI_UINT64_T, MPI_SUM,
+      comm);
+
+  nmod_mat_zero(X);
+  for (slong i = 0; i < ncols; i++) {
+    for (slong l = 0; l < m; l++) {
+      nmod_mat_entry(X, i, l) = part[i*m + l];
+    }
+  }
+  return nullity;
+}
+
+int arora_ge_recover_distributed(nmod_mat_t den, nmod_mat_t H_mat,
+    NTRUKeyGen& ctx, MPI_Comm comm, int nthreads) {
+  set_log_level(ctx.log_level());
+
+  int id, size;
+  MPI_Comm_rank(comm, &id);
+  MPI_Comm_size(comm, &size);
+  int n = ctx.degree();
+  int nkeys = nmod_mat_nrows(H_mat);
+  ulong ncols = num_variables(n, ctx.coeffs());
+
+  // rank id builds the rows of keys first, ..., last - 1
+  int first = (slong) nkeys*id/size;
+  int last = (slong) nkeys*(id + 1)/size;
+  nmod_mat_t band, keys;
+  nmod_mat_init(band, n*(last - first), ncols, ctx.q());
+  if (last > first) {
+    nmod_mat_window_init(keys, H_mat, first, 0, last, n);
+    arora_ge_system(band, keys, ctx, nthreads);
+    nmod_mat_window_clear(keys);
+  }
+
+  nmod_mat_t initial_kernel;
+  nmod_mat_init(initial_kernel, ncols, n + 1, ctx.q());
+  int rank = arora_ge_nullspace_distributed(initial_kernel, band, comm);
+  nmod_mat_clear(band);
+
+  // every rank holds the same kernel, so they all recover the same key
+  int status = arora_ge_recover_kernel(den, initial_kernel, rank, ctx);
+  nmod_mat_clear(initial_kernel);
+  return status;
+}
@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+#include <flint.h>
+#include <nmod_mat.h>
+
+#include "echelon.hpp"
+#include "scheduler.hpp"
+#include "extras.hpp"
+
+slong nmod_mat_rref_parallel(nmod_mat_t A, int nthreads) {
+  slong nrows = nmod_mat_nrows(A);
+  slong ncols = nmod_mat_ncols(A);
+
+  // a few tiles per thread, so that threads stay busy as the pivot rows of
+  // each tile are applied to the ones after it
+  slong rows_per_tile = std::max((slong) 32,
+      (nrows + 4*nthreads - 1) / std::max(1, 4*nthreads));
+  if (nthreads <= 1 || nrows < 2*rows_per_tile) {
+    return nmod_mat_rref(A);
+  }
+  slong ntiles = (nrows + rows_per_tile - 1)/rows_per_tile;
+
+  // tiles are windows of A; pivots[k] are the pivot columns of the first
+  // pivots[k].size() rows of tile k once its panel task has run
+  std::vector<nmod_mat_struct> tiles(ntiles);
+  std::vector<std::vector<slong>> pivots(ntiles);
+  for (slong k = 0; k < ntiles; k++) {
+    nmod_mat_window_init(&tiles[k], A, k*rows_per_tile, 0,
+        std::min(nrows, (k + 1)*rows_per_tile), ncols);
+  }
+
+  auto panel = [&](slong k) {
+    nmod_mat_t P;
+    nmod_mat_init_set(P, &tiles[k]);
+    slong rank = nmod_mat_rref(P);
+    for (slong i = 0; i < rank; i++) {
+      slong c = 0;
+      while (nmod_mat_entry(P, i, c) == 0) {
+        c++;
+      }
+      pivots[k].push_back(c);
+    }
+    nmod_mat_set(&tiles[k], P);
+    nmod_mat_clear(P);
+  };
+
+  // A[j] -= A[j][:, pivots[k]] R[k], over the pivot rows of j if only_pivots
+  auto reduce = [&](slong j, slong k, bool only_pivots) {
+    if (pivots[k].empty() || (only_pivots && pivots[j].empty())) {
+      return;
+    }
+    nmod_mat_t R, T;
+    nmod_mat_window_init(R, &tiles[k], 0, 0, pivots[k].size(), ncols);
+    nmod_mat_window_init(T, &tiles[j], 0, 0,
+        only_pivots ? (slong) pivots[j].size() : nmod_mat_nrows(&tiles[j]),
+        ncols);
+    nmod_mat_reduce_pivots(T, pivots[k], R);
+    nmod_mat_window_clear(T);
+    nmod_mat_window_clear(R);
+  };
+
+  // last[j] is the last task so far that writes tile j; the tasks writing a
+  // tile are chained, and a tile is read once its chain up to then is done
+  TaskGraph graph;
+  std::vector<size_t> last(ntiles);
+  for (slong k = 0; k < ntiles; k++) {
+    size_t t = graph.add([&, k]() { panel(k); });
+    if (k > 0) {
+      graph.depend(t, last[k]);
+    }
+    last[k] = t;
+    for (slong j = k + 1; j < ntiles; j++) {
+      size_t u = graph.add([&, j, k]() { reduce(j, k, false); });
+      graph.depend(u, last[k]);
+      if (k > 0) {
+        graph.depend(u, last[j]);
+      }
+      last[j] = u;
+    }
+  }
+  for (slong k = ntiles - 1; k > 0; k--) {
+    for (slong i = 0; i < k; i++) {
+      size_t u = graph.add([&, i, k]() { reduce(i, k, true); });
+      graph.depend(u, last[k]);
+      graph.depend(u, last[i]);
+      last[i] = u;
+    }
+  }
+  graph.run(nthreads);
+
+  for (slong k = 0; k < ntiles; k++) {
+    nmod_mat_window_clear(&tiles[k]);
+  }
+
+  // move the pivot rows to the top of A, ordered by pivot column; the other
+  // rows are zero
+  std::vector<std::tuple<slong, slong>> order;
+  for (slong k = 0; k < ntiles; k++) {
+    for (size_t i = 0; i < pivots[k].size(); i++) {
+      order.emplace_back(pivots[k][i], k*rows_per_tile + i);
+    }
+  }
+  std::sort(order.begin(), order.end());
+  slong rank = order.size();
+
+  // at[p] is the original row now at position p, where[r] the position of
+  // original row r
+  std::vector<slong> at(nrows), where(nrows);
+  for (slong r = 0; r < nrows; r++) {
+    at[r] = r;
+    where[r] = r;
+  }
+  for (slong p = 0; p < rank; p++) {
+    slong r = std::get<1>(order[p]);
+    slong s = where[r];
+    if (s != p) {
+      nmod_mat_swap_rows(A, NULL, p, s);
+      std::swap(at[p], at[s]);
+      where[at[p]] = p;
+      where[at[s]] = s;
+    }
+  }
+  return rank;
+}
@@ -1,4 +1,5 @@
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <sstream>
@@ -11,6 +12,10 @@
 #include <nmod_poly.h>
 
 #include "extras.hpp"
+#include "echelon.hpp"
+#ifdef ARORA_GE_BLAS
+#include "blas.hpp"
+#endif
 
 // convert 1xn matrix to polynomial. Assumes mat and poly have
 // correct size
@@ -42,6 +47,72 @@ int power_product(nmod_mat_t row, std::vector<int> const &idx_vec) {
   return res;
 }
 
+// Set res to the products of all multisets of d entries of row (of length n),
+// each scaled by its multinomial coefficient, in the order used for the 
+// columns of the linear system: index tuples 0 <= c_1 <= ... <= c_d < n in
+// lexicographic order. The tuples are walked depth first so each product 
+// reuses the product of its prefix and costs a single multiplication.
+void monomial_products(mp_limb_t * res, const mp_limb_t * row, int n, int d, 
+    nmod_t mod) {
+  // scaled[u*n + c] is row[c] times the multinomial coefficient of a 
+  // monomial with u repeated indices, so the coefficient is folded into the 
+  // last factor.
+  std::vector<mp_limb_t> scaled(d*n);
+  for (int u = 0; u < d; u++) {
+    mp_limb_t coeff = factorial(d, u + 1) % mod.n;
+    for (int c = 0; c < n; c++) {
+      scaled[u*n + c] = nmod_mul(coeff, row[c], mod);
+    }
+  }
+
+  if (d == 1) {
+    for (int c = 0; c < n; c++) {
+      res[c] = scaled[c];
+    }
+    return;
+  }
+
+  // idx, prefix and reps hold the first d - 1 indices of the current tuple,
+  // the product of their entries and their number of repeated indices.
+  std::vector<int> idx(d - 1, 0);
+  std::vector<mp_limb_t> prefix(d - 1);
+  std::vector<int> reps(d - 1);
+
+  slong k = 0;
+  int l = 0;
+  while (true) {
+    if (l == 0) {
+      prefix[0] = row[idx[0]];
+      reps[0] = 0;
+    } else {
+      prefix[l] = nmod_mul(prefix[l-1], row[idx[l]], mod);
+      reps[l] = reps[l-1] + (idx[l] == idx[l-1]);
+    }
+
+    if (l < d - 2) {
+      idx[l+1] = idx[l];
+      l++;
+      continue;
+    }
+
+    // last index runs from idx[l] to n - 1
+    int a = idx[l];
+    mp_limb_t p = prefix[l];
+    res[k++] = nmod_mul(p, scaled[(reps[l] + 1)*n + a], mod);
+    for (int c = a + 1; c < n; c++) {
+      res[k++] = nmod_mul(p, scaled[reps[l]*n + c], mod);
+    }
+
+    while (l >= 0 && idx[l] == n - 1) {
+      l--;
+    }
+    if (l < 0) {
+      break;
+    }
+    idx[l]++;
+  }
+}
+
 // Only for small values.
 int factorial(int n, int k) {
   int res = 1;
@@ -134,11 +205,18 @@ void nmod_mat_init_from_stream(nmod_mat_t mat, int q, std::istream& is) {
 }
 
 void nmod_mat_to_stream(nmod_mat_t mat, std::ostream& os) {
+    os << "[";
+    nmod_mat_rows_to_stream(mat, os);
+    os << "]";
+}
+
+// Write only the rows of mat, in the format of nmod_mat_to_stream. Used to
+// write a matrix one block of rows at a time.
+void nmod_mat_rows_to_stream(nmod_mat_t mat, std::ostream& os) {
     int nrows = nmod_mat_nrows(mat);
     int ncols = nmod_mat_ncols(mat);
 
     int i, j;
-    os << "[";
     for (i = 0; i < nrows; i++) {
         os << "[";
         for (j = 0; j < ncols; j++) {
@@ -150,5 +228,113 @@ void nmod_mat_to_stream(nmod_mat_t mat, std::ostream& os) {
             }
         }
     }
-    os << "]";
-}
\ No newline at end of file
+}
+// Replace the first rank columns of X, a basis of the kernel of some matrix A,
+// by the basis nmod_mat_nullspace(X, A) returns and zero the other columns.
+// That basis has a 1 in each non-pivot column of rref(A) and 0 in the others,
+// and a column j of A is a non-pivot column exactly when some kernel vector 
+// ends in position j. So it is the reduced echelon form of the kernel with 
+// the columns taken in reverse order.
+void nmod_mat_nullspace_canonical(nmod_mat_t X, slong rank) {
+  slong ncols = nmod_mat_nrows(X);
+
+  nmod_mat_t B;
+  nmod_mat_init(B, rank, ncols, X->mod.n);
+  for (slong i = 0; i < rank; i++) {
+    for (slong j = 0; j < ncols; j++) {
+      nmod_mat_entry(B, i, ncols - 1 - j) = nmod_mat_entry(X, j, i);
+    }
+  }
+  nmod_mat_rref(B);
+
+  // row i of B has the i-th last pivot, nmod_mat_nullspace sorts them
+  nmod_mat_zero(X);
+  for (slong i = 0; i < rank; i++) {
+    for (slong j = 0; j < ncols; j++) {
+      nmod_mat_entry(X, j, rank - 1 - i) = nmod_mat_entry(B, i, ncols - 1 - j);
+    }
+  }
+  nmod_mat_clear(B);
+}
+
+// A -= A[:, cols] B, where row l of B has its pivot in column cols[l].
+// Returns false if A[:, cols] is zero and A is unchanged. B is zero before 
+// its first pivot column, so only the columns from there on are updated.
+bool nmod_mat_reduce_pivots(nmod_mat_t A, const std::vector<slong>& cols, 
+    nmod_mat_t B) {
+  slong nrows = nmod_mat_nrows(A);
+  slong ncols = nmod_mat_ncols(A);
+  slong r = cols.size();
+  nmod_mat_t G, U, Aw, Bw;
+  nmod_mat_init(G, nrows, r, A->mod.n);
+  for (slong i = 0; i < nrows; i++) {
+    for (slong l = 0; l < r; l++) {
+      nmod_mat_entry(G, i, l) = nmod_mat_entry(A, i, cols[l]);
+    }
+  }
+  bool nonzero = !nmod_mat_is_zero(G);
+  if (nonzero) {
+    slong first = *std::min_element(cols.begin(), cols.end());
+    nmod_mat_window_init(Aw, A, 0, first, nrows, ncols);
+    nmod_mat_window_init(Bw, B, 0, first, r, ncols);
+    nmod_mat_init(U, nrows, ncols - first, A->mod.n);
+    nmod_mat_mul(U, G, Bw);
+    nmod_mat_sub(Aw, Aw, U);
+    nmod_mat_clear(U);
+    nmod_mat_window_clear(Bw);
+    nmod_mat_window_clear(Aw);
+  }
+  nmod_mat_clear(G);
+  return nonzero;
+}
+
+// Kernel of A in the basis nmod_mat_nullspace returns, with A reduced to its
+// rref in place instead of a copy. X is initialized to ncols(A) x rank. If 
+// the rank exceeds cap, which is known before any elimination when A has 
+// fewer than ncols(A) - cap rows, X is initialized with no columns, rank is 
+// set to a lower bound and 1 is returned. The rref is computed by 
+// nmod_mat_rref_parallel with nthreads threads, or with a single thread by
+// nmod_mat_rref_blas when built with a BLAS and q is small enough for it.
+int nmod_mat_nullspace_capped(nmod_mat_t X, slong& rank, nmod_mat_t A, 
+    slong cap, int nthreads) {
+  slong nrows = nmod_mat_nrows(A);
+  slong ncols = nmod_mat_ncols(A);
+  mp_limb_t q = A->mod.n;
+
+  if (ncols - nrows > cap) {
+    rank = ncols - nrows;
+    nmod_mat_init(X, ncols, 0, q);
+    return 1;
+  }
+#ifdef ARORA_GE_BLAS
+  slong r = (nthreads <= 1 && blas_fits(q)) ? nmod_mat_rref_blas(A) 
+    : nmod_mat_rref_parallel(A, nthreads);
+#else
+  slong r = nmod_mat_rref_parallel(A, nthreads);
+#endif
+  rank = ncols - r;
+  if (rank > cap) {
+    nmod_mat_init(X, ncols, 0, q);
+    return 1;
+  }
+
+  std::vector<slong> pivots, nonpivot;
+  for (slong i = 0, c = 0; c < ncols; c++) {
+    if (i < r && nmod_mat_entry(A, i, c) != 0) {
+      pivots.push_back(c);
+      i++;
+    } else {
+      nonpivot.push_back(c);
+    }
+  }
+
+  nmod_mat_init(X, ncols, rank, q);
+  for (slong l = 0; l < rank; l++) {
+    nmod_mat_entry(X, nonpivot[l], l) = 1;
+    for (slong i = 0; i < r; i++) {
+      nmod_mat_entry(X, pivots[i], l) = 
+        nmod_neg(nmod_mat_entry(A, i, nonpivot[l]), A->mod);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,264 @@
+#include <cassert>
+#include <vector>
+
+#include <flint.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+#include "kernels.hpp"
+
+namespace {
+
+// Barrett reduction of x < 2^32 modulo q < 2^16 with m = floor(2^32 / q).
+// t = floor(x m / 2^32) is at most one less than floor(x / q), so 
+// x - t q < 2 q needs a single correction.
+struct barrett32 {
+  uint32_t q;
+  uint32_t m;
+};
+
+inline uint32_t barrett_mul(uint32_t a, uint32_t b, const barrett32& b32) {
+  uint32_t x = a * b;
+  uint32_t t = (uint32_t) (((uint64_t) x * b32.m) >> 32);
+  uint32_t r = x - t * b32.q;
+  return r >= b32.q ? r - b32.q : r;
+}
+
+// out[i] = s v[i] mod q for 0 <= i < len, widened to limbs.
+typedef void (*scale_fn)(mp_limb_t *, const uint32_t *, slong, uint32_t, 
+    const barrett32&);
+
+void scale_scalar(mp_limb_t * out, const uint32_t * v, slong len, uint32_t s, 
+    const barrett32& b32) {
+  for (slong i = 0; i < len; i++) {
+    out[i] = barrett_mul(s, v[i], b32);
+  }
+}
+
+// acc[i] += c v[i] for 0 <= i < len, without reduction.
+typedef void (*addmul16_fn)(uint64_t *, const uint16_t *, slong, uint32_t);
+typedef void (*addmul32_fn)(uint64_t *, const uint32_t *, slong, uint32_t);
+
+template <typename T>
+void addmul_scalar(uint64_t * acc, const T * v, slong len, uint32_t c) {
+  for (slong i = 0; i < len; i++) {
+    acc[i] += (uint64_t) c * v[i];
+  }
+}
+
+#ifdef KERNELS_X86
+
+__attribute__((target("avx2")))
+void scale_avx2(mp_limb_t * out, const uint32_t * v, slong len, uint32_t s, 
+    const barrett32& b32) {
+  const __m256i vs = _mm256_set1_epi32(s);
+  const __m256i vq = _mm256_set1_epi32(b32.q);
+  const __m256i vm = _mm256_set1_epi32(b32.m);
+  slong i = 0;
+  for (; i + 8 <= len; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i *) (v + i));
+    x = _mm256_mullo_epi32(x, vs);
+    // high halves of the 32 x 32 -> 64 bit products x m, even and odd lanes
+    __m256i lo = _mm256_mul_epu32(x, vm);
+    __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(x, 32), vm);
+    __m256i t = _mm256_blend_epi32(_mm256_srli_epi64(lo, 32), hi, 0xAA);
+    __m256i r = _mm256_sub_epi32(x, _mm256_mullo_epi32(t, vq));
+    r = _mm256_min_epu32(r, _mm256_sub_epi32(r, vq));
+    _mm256_storeu_si256((__m256i *) (out + i), 
+        _mm256_cvtepu32_epi64(_mm256_castsi256_si128(r)));
+    _mm256_storeu_si256((__m256i *) (out + i + 4), 
+        _mm256_cvtepu32_epi64(_mm256_extracti128_si256(r, 1)));
+  }
+  scale_scalar(out + i, v + i, len - i, s, b32);
+}
+
+// The entries are widened to 64-bit lanes, whose low halves are multiplied
+// by c into full 64-bit products.
+__attribute__((target("avx2")))
+void addmul16_avx2(uint64_t * acc, const uint16_t * v, slong len, uint32_t c) {
+  const __m256i vc = _mm256_set1_epi64x(c);
+  slong i = 0;
+  for (; i + 4 <= len; i += 4) {
+    __m256i x = _mm256_cvtepu16_epi64(_mm_loadl_epi64((const __m128i *) (v + i)));
+    __m256i a = _mm256_loadu_si256((const __m256i *) (acc + i));
+    a = _mm256_add_epi64(a, _mm256_mul_epu32(x, vc));
+    _mm256_storeu_si256((__m256i *) (acc + i), a);
+  }
+  addmul_scalar(acc + i, v + i, len - i, c);
+}
+
+__attribute__((target("avx2")))
+void addmul32_avx2(uint64_t * acc, const uint32_t * v, slong len, uint32_t c) {
+  const __m256i vc = _mm256_set1_epi64x(c);
+  slong i = 0;
+  for (; i + 4 <= len; i += 4) {
+    __m256i x = _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *) (v + i)));
+    __m256i a = _mm256_loadu_si256((const __m256i *) (acc + i));
+    a = _mm256_add_epi64(a, _mm256_mul_epu32(x, vc));
+    _mm256_storeu_si256((__m256i *) (acc + i), a);
+  }
+  addmul_scalar(acc + i, v + i, len - i, c);
+}
+
+// GCC 12 reports false positives for the undefined vectors used inside the 
+// AVX-512 intrinsics.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+__attribute__((target("avx512f")))
+void scale_avx512(mp_limb_t * out, const uint32_t * v, slong len, uint32_t s, 
+    const barrett32& b32) {
+  const __m512i vs = _mm512_set1_epi32(s);
+  const __m512i vq = _mm512_set1_epi32(b32.q);
+  const __m512i vm = _mm512_set1_epi32(b32.m);
+  slong i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m512i x = _mm512_loadu_si512((const void *) (v + i));
+    x = _mm512_mullo_epi32(x, vs);
+    __m512i lo = _mm512_mul_epu32(x, vm);
+    __m512i hi = _mm512_mul_epu32(_mm512_srli_epi64(x, 32), vm);
+    __m512i t = _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(lo, 32), hi);
+    __m512i r = _mm512_sub_epi32(x, _mm512_mullo_epi32(t, vq));
+    r = _mm512_min_epu32(r, _mm512_sub_epi32(r, vq));
+    _mm512_storeu_si512((void *) (out + i), 
+        _mm512_cvtepu32_epi64(_mm512_castsi512_si256(r)));
+    _mm512_storeu_si512((void *) (out + i + 8), 
+        _mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(r, 1)));
+  }
+  scale_scalar(out + i, v + i, len - i, s, b32);
+}
+
+__attribute__((target("avx512f")))
+void addmul16_avx512(uint64_t * acc, const uint16_t * v, slong len, 
+    uint32_t c) {
+  const __m512i vc = _mm512_set1_epi64(c);
+  slong i = 0;
+  for (; i + 8 <= len; i += 8) {
+    __m512i x = _mm512_cvtepu16_epi64(_mm_loadu_si128((const __m128i *) (v + i)));
+    __m512i a = _mm512_loadu_si512((const void *) (acc + i));
+    a = _mm512_add_epi64(a, _mm512_mul_epu32(x, vc));
+    _mm512_storeu_si512((void *) (acc + i), a);
+  }
+  addmul_scalar(acc + i, v + i, len - i, c);
+}
+
+__attribute__((target("avx512f")))
+void addmul32_avx512(uint64_t * acc, const uint32_t * v, slong len, 
+    uint32_t c) {
+  const __m512i vc = _mm512_set1_epi64(c);
+  slong i = 0;
+  for (; i + 8 <= len; i += 8) {
+    __m512i x = _mm512_cvtepu32_epi64(_mm256_loadu_si256((const __m256i *) (v + i)));
+    __m512i a = _mm512_loadu_si512((const void *) (acc + i));
+    a = _mm512_add_epi64(a, _mm512_mul_epu32(x, vc));
+    _mm512_storeu_si512((void *) (acc + i), a);
+  }
+  addmul_scalar(acc + i, v + i, len - i, c);
+}
+
+#pragma GCC diagnostic pop
+
+#endif
+
+struct kernel_set {
+  scale_fn scale;
+  addmul16_fn addmul16;
+  addmul32_fn addmul32;
+  const char * name;
+};
+
+kernel_set select_kernels() {
+#ifdef KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return {scale_avx512, addmul16_avx512, addmul32_avx512, "avx512"};
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return {scale_avx2, addmul16_avx2, addmul32_avx2, "avx2"};
+  }
+#endif
+  return {scale_scalar, addmul_scalar<uint16_t>, addmul_scalar<uint32_t>, 
+    "scalar"};
+}
+
+const kernel_set& kernel() {
+  static const kernel_set k = select_kernels();
+  return k;
+}
+
+}
+
+bool monomial_kernel_supported(ulong q, int d) {
+  return q < (UWORD(1) << 16) && (d == 2 || d == 3);
+}
+
+const char * monomial_kernel_name() {
+  return kernel().name;
+}
+
+// The innermost index of every monomial runs over a contiguous range of the
+// row, so each inner loop is a scalar (the product of the other indices) 
+// times a vector (the pre-scaled row), which is what the SIMD kernel does.
+void monomial_kernel_rows(mp_limb_t * const * out, const uint32_t * rows, 
+    slong nrows, int n, int d, uint32_t q) {
+  assert(monomial_kernel_supported(q, d));
+
+  barrett32 b32 = {q, (uint32_t) ((UWORD(1) << 32) / q)};
+  scale_fn scale = kernel().scale;
+
+  // s[u*n + c] is row[c] times the coefficient of a monomial with u 
+  // repeated indices: 2, 1 for d = 2 and 6, 3, 1 for d = 3
+  std::vector<uint32_t> s((d - 1)*n);
+  uint32_t c0 = (d == 2 ? 2 : 6) % q;
+  uint32_t c1 = 3 % q;
+
+  for (slong i = 0; i < nrows; i++) {
+    const uint32_t * row = rows + i*n;
+    mp_limb_t * res = out[i];
+
+    for (int c = 0; c < n; c++) {
+      s[c] = barrett_mul(c0, row[c], b32);
+      if (d == 3) {
+        s[n + c] = barrett_mul(c1, row[c], b32);
+      }
+    }
+
+    if (d == 2) {
+      for (int a = 0; a < n; a++) {
+        uint32_t pa = row[a];
+        *res++ = barrett_mul(pa, pa, b32);
+        scale(res, s.data() + a + 1, n - a - 1, pa, b32);
+        res += n - a - 1;
+      }
+    } else {
+      const uint32_t * s6 = s.data();
+      const uint32_t * s3 = s.data() + n;
+      for (int a = 0; a < n; a++) {
+        uint32_t pa = row[a];
+        uint32_t paa = barrett_mul(pa, pa, b32);
+        *res++ = barrett_mul(paa, pa, b32);
+        scale(res, s3 + a + 1, n - a - 1, paa, b32);
+        res += n - a - 1;
+        for (int b = a + 1; b < n; b++) {
+          uint32_t pab = barrett_mul(pa, row[b], b32);
+          *res++ = barrett_mul(pab, s3[b], b32);
+          scale(res, s6 + b + 1, n - b - 1, pab, b32);
+          res += n - b - 1;
+        }
+      }
+    }
+  }
+}
+
+void row_kernel_addmul(uint64_t * acc, const uint16_t * v, slong len, 
+    uint32_t c) {
+  kernel().addmul16(acc, v, len, c);
+}
+
+void row_kernel_addmul(uint64_t * acc, const uint32_t * v, slong len, 
+    uint32_t c) {
+  kernel().addmul32(acc, v, len, c);
+}
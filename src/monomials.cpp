@@ -0,0 +1,114 @@
+#include <cassert>
+#include <vector>
+
+#include <flint.h>
+
+#include "monomials.hpp"
+#include "extras.hpp"
+
+MonomialTable::MonomialTable(int n, int d) {
+  assert(n > 0 && n <= UINT16_MAX + 1);
+  assert(d > 0 && d <= UINT8_MAX);
+
+  this->n_ = n;
+  this->d_ = d;
+  this->size_ = bin_uiui(n + d - 1, d);
+
+  int m = n + d - 1;
+  this->bins_.assign((m + 1)*(d + 1), 0);
+  for (int x = 0; x <= m; x++) {
+    this->bins_[x*(d + 1)] = 1;
+    for (int k = 1; k <= d && k <= x; k++) {
+      this->bins_[x*(d + 1) + k] = this->bins_[(x - 1)*(d + 1) + k - 1] 
+        + this->bins_[(x - 1)*(d + 1) + k];
+    }
+  }
+
+  this->idx_.resize(this->size_ * d);
+  this->unique_.resize(this->size_);
+
+  // Walk the tuples in lexicographic order, as in monomial_products.
+  std::vector<int> tuple(d, 0);
+  for (ulong k = 0; k < this->size_; k++) {
+    int u = 0;
+    for (int i = 0; i < d; i++) {
+      this->idx_[k*d + i] = tuple[i];
+      if (i > 0 && tuple[i] == tuple[i-1]) {
+        u++;
+      }
+    }
+    this->unique_[k] = u;
+
+    int l = d - 1;
+    while (l >= 0 && tuple[l] == n - 1) {
+      l--;
+    }
+    if (l < 0) {
+      break;
+    }
+    tuple[l]++;
+    for (int i = l + 1; i < d; i++) {
+      tuple[i] = tuple[l];
+    }
+  }
+}
+
+// The tuple c_0 <= ... <= c_{d-1} corresponds to the d-subset 
+// p_i = c_i + i of {0, ..., n + d - 2}. Its lexicographic rank follows from
+// the combinatorial number system representation of the complement 
+// m - 1 - p_i.
+template <typename T>
+ulong MonomialTable::rank(const T * tuple) const {
+  int d = this->d_;
+  int m = this->n_ + d - 1;
+  ulong r = 0;
+  for (int i = 0; i < d; i++) {
+    r += this->bins_[(m - 1 - (int) tuple[i] - i)*(d + 1) + d - i];
+  }
+  return this->size_ - 1 - r;
+}
+
+template ulong MonomialTable::rank(const int *) const;
+template ulong MonomialTable::rank(const uint16_t *) const;
+
+ulong MonomialTable::column(ulong k, bool fold) const {
+  if (!fold) {
+    return this->n_ + k;
+  }
+  const uint16_t * tuple = this->unrank(k);
+  if (tuple[0] == tuple[this->d_ - 1]) {
+    return tuple[0];
+  }
+  return this->n_ + k - (tuple[0] + 1);
+}
+
+void MonomialTable::rotation(std::vector<uint32_t>& map, 
+    std::vector<uint8_t>& negate, bool negacyclic) const {
+  int n = this->n_;
+  int d = this->d_;
+  assert(this->size_ <= UINT32_MAX);
+
+  map.resize(this->size_);
+  negate.assign(this->size_, 0);
+
+  // Shifting the indices down by one keeps them sorted, except that the 
+  // zeros wrap around to n - 1 and move to the end.
+  std::vector<int> shifted(d);
+  for (ulong k = 0; k < this->size_; k++) {
+    const uint16_t * tuple = this->unrank(k);
+    int z = 0;
+    while (z < d && tuple[z] == 0) {
+      z++;
+    }
+    for (int i = z; i < d; i++) {
+      shifted[i - z] = tuple[i] - 1;
+    }
+    for (int i = d - z; i < d; i++) {
+      shifted[i] = n - 1;
+    }
+    map[k] = this->rank(shifted.data());
+    if (negacyclic) {
+      negate[k] = z & 1;
+    }
+  }
+}
@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include <flint.h>
+#include <nmod.h>
+#include <nmod_mat.h>
+
+#include "packed.hpp"
+#include "system.hpp"
+#include "extras.hpp"
+#include "kernels.hpp"
+#include "logging.hpp"
+
+template <typename T>
+void packed_from_stream(PackedMatrix<T>& res, std::istream& is) {
+  char c;
+  std::string line;
+  mp_limb_t q = res.mod().n;
+
+  is >> c;
+  if (c != '[') {
+    throw "Invalid matrix";
+  }
+  for (slong i = 0; i < res.nrows(); i++) {
+    if (!(is >> c) || c != '[') {
+      throw "Invalid matrix";
+    }
+    std::getline(is, line);
+    auto row = parse_line(line);
+    T * r = res.row(i);
+    for (slong j = 0; j < res.ncols(); j++) {
+      r[j] = std::stoul(row[j]) % q;
+    }
+  }
+}
+
+template <typename T>
+void arora_ge_system_packed(PackedMatrix<T>& res, nmod_mat_t H_mat,
+    const NTRUKeyGen& keygen, int nthreads, bool fold) {
+  int n = keygen.degree();
+  int nkeys = nmod_mat_nrows(H_mat);
+  slong ncols = res.ncols();
+  assert(res.nrows() == n*nkeys);
+  assert((ulong) ncols == num_variables(n, keygen.coeffs(), fold));
+
+  // only a batch of nthreads keys is held in 64-bit limbs at a time
+  int batch = std::max(1, std::min(nthreads, nkeys));
+  SystemBuilder builder(keygen, fold);
+  nmod_mat_t block, keys, window;
+  nmod_mat_init(block, n*batch, ncols, keygen.q());
+  for (int i = 0; i < nkeys; i += batch) {
+    int b = std::min(batch, nkeys - i);
+    nmod_mat_window_init(keys, H_mat, i, 0, i + b, n);
+    nmod_mat_window_init(window, block, 0, 0, n*b, ncols);
+    arora_ge_system(window, keys, builder, nthreads);
+    res.set_rows(n*i, window);
+    nmod_mat_window_clear(window);
+    nmod_mat_window_clear(keys);
+  }
+  nmod_mat_clear(block);
+}
+
+namespace {
+
+// Number of products of two reduced entries that can be added to a
+// reduced entry in 64 bits.
+ulong accumulator_terms(mp_limb_t q) {
+  ulong max = (q - 1)*(q - 1);
+  return max == 0 ? UINT64_MAX : (UINT64_MAX - (q - 1))/max;
+}
+
+}
+
+// Rows are added one at a time to a semi-echelon basis, where each row is
+// zero at the pivots of the rows before it. A new row is reduced by the
+// basis rows in order with the SIMD row kernel, reading each coefficient 
+// from the accumulator, so only one entry needs reducing per step. The 
+// basis is then made reduced from the last row up: the rows after a row are
+// already zero at each other's pivots, so all of its coefficients are known
+// up front.
+template <typename T>
+slong packed_rref(PackedMatrix<T>& A, std::vector<slong>& rows,
+    std::vector<slong>& pivots) {
+  slong ncols = A.ncols();
+  nmod_t mod = A.mod();
+  mp_limb_t q = mod.n;
+  ulong max_terms = accumulator_terms(q);
+
+  rows.clear();
+  pivots.clear();
+  std::vector<uint64_t> acc(ncols);
+  auto reduce = [&]() {
+    for (slong j = 0; j < ncols; j++) {
+      acc[j] %= q;
+    }
+  };
+
+  for (slong i = 0; i < A.nrows(); i++) {
+    T * r = A.row(i);
+    for (slong j = 0; j < ncols; j++) {
+      acc[j] = r[j];
+    }
+    ulong terms = 0;
+    for (size_t b = 0; b < rows.size(); b++) {
+      uint64_t c = acc[pivots[b]] % q;
+      if (c == 0) {
+        continue;
+      }
+      if (terms == max_terms) {
+        reduce();
+        terms = 0;
+      }
+      // basis rows are zero before their pivot
+      slong p = pivots[b];
+      row_kernel_addmul(acc.data() + p, A.row(rows[b]) + p, ncols - p, q - c);
+      terms++;
+    }
+    reduce();
+
+    slong p = 0;
+    while (p < ncols && acc[p] == 0) {
+      p++;
+    }
+    if (p == ncols) {
+      std::fill(r, r + ncols, 0);
+      continue;
+    }
+    mp_limb_t inv = nmod_inv(acc[p], mod);
+    for (slong j = 0; j < ncols; j++) {
+      r[j] = nmod_mul(acc[j], inv, mod);
+    }
+    rows.push_back(i);
+    pivots.push_back(p);
+  }
+
+  slong rank = rows.size();
+  for (slong b = rank - 2; b >= 0; b--) {
+    T * r = A.row(rows[b]);
+    for (slong j = 0; j < ncols; j++) {
+      acc[j] = r[j];
+    }
+    ulong terms = 0;
+    for (slong a = b + 1; a < rank; a++) {
+      uint64_t c = r[pivots[a]];
+      if (c == 0) {
+        continue;
+      }
+      if (terms == max_terms) {
+        reduce();
+        terms = 0;
+      }
+      slong p = pivots[a];
+      row_kernel_addmul(acc.data() + p, A.row(rows[a]) + p, ncols - p, q - c);
+      terms++;
+    }
+    reduce();
+    for (slong j = 0; j < ncols; j++) {
+      r[j] = acc[j];
+    }
+  }
+  return rank;
+}
+
+template <typename T>
+int packed_nullspace(nmod_mat_t X, slong& rank, PackedMatrix<T>& A, 
+    slong cap) {
+  slong ncols = A.ncols();
+  if (ncols - A.nrows() > cap) {
+    rank = ncols - A.nrows();
+    nmod_mat_init(X, ncols, 0, A.mod().n);
+    return 1;
+  }
+
+  std::vector<slong> rows, pivots;
+  slong r = packed_rref(A, rows, pivots);
+  debug("Packed rank: ", r, "\n");
+  rank = ncols - r;
+  if (rank > cap) {
+    nmod_mat_init(X, ncols, 0, A.mod().n);
+    return 1;
+  }
+
+  // one kernel vector for each non-pivot column, as in nmod_mat_nullspace
+  std::vector<uint8_t> is_pivot(ncols, 0);
+  for (slong c : pivots) {
+    is_pivot[c] = 1;
+  }
+  std::vector<slong> nonpivot;
+  for (slong c = 0; c < ncols; c++) {
+    if (!is_pivot[c]) {
+      nonpivot.push_back(c);
+    }
+  }
+
+  nmod_mat_init(X, ncols, rank, A.mod().n);
+  for (slong l = 0; l < rank; l++) {
+    nmod_mat_entry(X, nonpivot[l], l) = 1;
+  }
+  for (slong i = 0; i < r; i++) {
+    const T * row = A.row(rows[i]);
+    for (slong l = 0; l < rank; l++) {
+      nmod_mat_entry(X, pivots[i], l) = nmod_neg(row[nonpivot[l]], A.mod());
+    }
+  }
+  return 0;
+}
+
+template void packed_from_stream(PackedMatrix<uint16_t>&, std::istream&);
+template void packed_from_stream(PackedMatrix<uint32_t>&, std::istream&);
+template void arora_ge_system_packed(PackedMatrix<uint16_t>&, nmod_mat_t,
+    const NTRUKeyGen&, int, bool);
+template void arora_ge_system_packed(PackedMatrix<uint32_t>&, nmod_mat_t,
+    const NTRUKeyGen&, int, bool);
+template slong packed_rref(PackedMatrix<uint16_t>&, std::vector<slong>&,
+    std::vector<slong>&);
+template slong packed_rref(PackedMatrix<uint32_t>&, std::vector<slong>&,
+    std::vector<slong>&);
+template int packed_nullspace(nmod_mat_t, slong&, PackedMatrix<uint16_t>&,
+    slong);
+template int packed_nullspace(nmod_mat_t, slong&, PackedMatrix<uint32_t>&,
+    slong);
@@ -9,30 +9,491 @@
 #include <nmod_poly.h>
 #include <nmod_mat.h>
 
+#include "recover.hpp"
 #include "system.hpp"
+#include "symmetry.hpp"
+#include "blackbox.hpp"
+#include "tiled.hpp"
+#include "packed.hpp"
+#include "checkpoint.hpp"
+#include "compress.hpp"
+#include "echelon.hpp"
+#include "tree.hpp"
+#include "scheduler.hpp"
+#include "monomials.hpp"
 #include "keygen.hpp"
+#include "extras.hpp"
 #include "logging.hpp"
 
 using namespace std;
 using namespace std::chrono;
 
 
-int arora_ge_recover(nmod_mat_t den, nmod_mat_t system, NTRUKeyGen& ctx) {
+// Set block to the rows of the kernel for the monomials whose first index 
+// is i, which start at row offset. With folded columns the first of these, 
+// x_i^d, is identified with x_i and found in linear row i instead.
+void kernel_block(nmod_mat_t block, nmod_mat_t kernel, int i, ulong offset, 
+    bool fold) {
+  int nrows = nmod_mat_nrows(block);
+  int ncols = nmod_mat_ncols(block);
+  int start = 0;
+  if (fold) {
+    for (int k = 0; k < ncols; k++) {
+      nmod_mat_entry(block, 0, k) = nmod_mat_entry(kernel, i, k);
+    }
+    start = 1;
+  }
+  for (int j = start; j < nrows; j++) {
+    for (int k = 0; k < ncols; k++) {
+      nmod_mat_entry(block, j, k) = nmod_mat_entry(kernel, offset + j - start, k);
+    }
+  }
+}
+
+// Set den to a rotation of the denominator read off the kernel of rank n, 
+// which is spanned by the monomial vectors v_j of the rotations g_j. With L 
+// the linear rows of the kernel and Q_t the rows of x_t^(d-1) x_s for 
+// s = 0, ..., n - 1, L^-1 Q_t has the eigenvalues g_j[t]^(d-1), with the 
+// coordinates of the v_j as eigenvectors. The eigenvector of a simple 
+// eigenvalue of a random combination of them gives one v_j, which is checked
+// to be the monomial vector of its linear part. The combinations come from
+// a fixed seed, so the rotation found depends only on the kernel. Returns 1
+// if none is found.
+int kernel_readout(nmod_mat_t den, nmod_mat_t kernel, bool fold, 
+    NTRUKeyGen& ctx) {
+  int n = ctx.degree();
+  int d = ctx.coeffs();
+  mp_limb_t q = ctx.q();
+  nmod_t mod = ctx.q_nmod();
+  int ncols = nmod_mat_nrows(kernel);
+
+  // the n eigenvalues lie in Z/q, so for q <= n some of them coincide
+  if (q <= (mp_limb_t) n) {
+    return 1;
+  }
+
+  // rows[t*n + s] is the row of x_t^(d-1) x_s, which is linear row t for 
+  // s = t with folded columns
+  MonomialTable table(n, d);
+  std::vector<ulong> rows(n*n);
+  std::vector<int> tuple(d);
+  for (int t = 0; t < n; t++) {
+    for (int s = 0; s < n; s++) {
+      std::fill(tuple.begin(), tuple.end(), t);
+      tuple[s < t ? 0 : d - 1] = s;
+      rows[t*n + s] = table.column(table.rank(tuple.data()), fold);
+    }
+  }
+
+  // L is replaced by its inverse
+  nmod_mat_t L, Q, M, u, v, w;
+  nmod_mat_init(L, n, n, q);
+  nmod_mat_init(M, n, n, q);
+  for (int s = 0; s < n; s++) {
+    for (int k = 0; k < n; k++) {
+      nmod_mat_entry(M, s, k) = nmod_mat_entry(kernel, s, k);
+    }
+  }
+  if (!nmod_mat_inv(L, M)) {
+    nmod_mat_clear(L);
+    nmod_mat_clear(M);
+    return 1;
+  }
+  nmod_mat_init(Q, n, n, q);
+  nmod_mat_init(u, n, n, q);
+  nmod_mat_init(w, ncols, 1, q);
+  nmod_poly_t charpoly;
+  nmod_poly_init(charpoly, q);
+  nmod_poly_factor_t roots;
+  nmod_poly_factor_init(roots);
+  flint_rand_t state;
+  flint_randinit(state);
+
+  int status = 1;
+  for (int attempt = 0; status && attempt < 4; attempt++) {
+    nmod_mat_zero(Q);
+    for (int t = 0; t < n; t++) {
+      mp_limb_t r = 1 + n_randint(state, q - 1);
+      for (int s = 0; s < n; s++) {
+        for (int k = 0; k < n; k++) {
+          nmod_mat_entry(Q, s, k) = nmod_addmul(nmod_mat_entry(Q, s, k), 
+              nmod_mat_entry(kernel, rows[t*n + s], k), r, mod);
+        }
+      }
+    }
+    nmod_mat_mul(M, L, Q);
+
+    nmod_mat_charpoly(charpoly, M);
+    nmod_poly_roots(roots, charpoly, 1);
+    slong i = 0;
+    while (i < roots->num && roots->exp[i] != 1) {
+      i++;
+    }
+    if (i == roots->num) {
+      continue;
+    }
+    mp_limb_t lambda = nmod_neg(nmod_poly_get_coeff_ui(roots->p + i, 0), mod);
+    for (int s = 0; s < n; s++) {
+      nmod_mat_entry(M, s, s) = nmod_sub(nmod_mat_entry(M, s, s), lambda, mod);
+    }
+    nmod_mat_nullspace(u, M);
+    nmod_mat_window_init(v, u, 0, 0, n, 1);
+    nmod_mat_mul(w, kernel, v);
+    nmod_mat_window_clear(v);
+
+    // the coefficients are 0 or +-1, so the first nonzero one fixes the 
+    // scale up to sign
+    int t0 = 0;
+    while (t0 < n && nmod_mat_entry(w, t0, 0) == 0) {
+      t0++;
+    }
+    if (t0 == n) {
+      continue;
+    }
+    mp_limb_t inv = nmod_inv(nmod_mat_entry(w, t0, 0), mod);
+    for (int t = 0; t < n; t++) {
+      nmod_mat_entry(den, 0, t) = nmod_mul(nmod_mat_entry(w, t, 0), inv, mod);
+    }
+    status = 0;
+    for (int t = 0; status == 0 && t < n; t++) {
+      mp_limb_t power = nmod_pow_ui(nmod_mat_entry(den, 0, t), d - 1, mod);
+      for (int s = 0; s < n; s++) {
+        mp_limb_t expected = nmod_mul(power, nmod_mat_entry(den, 0, s), mod);
+        if (nmod_mul(nmod_mat_entry(w, rows[t*n + s], 0), inv, mod) 
+            != expected) {
+          status = 1;
+          break;
+        }
+      }
+    }
+  }
+
+  flint_randclear(state);
+  nmod_poly_factor_clear(roots);
+  nmod_poly_clear(charpoly);
+  nmod_mat_clear(L);
+  nmod_mat_clear(Q);
+  nmod_mat_clear(M);
+  nmod_mat_clear(u);
+  nmod_mat_clear(w);
+  return status;
+}
+
+// Add the kernel blocks i, i + 1, ... to submat, the blocks kept so far, 
+// until the kernel of submat has rank 1, and set den from that kernel. 
+// submat is kept in reduced echelon form, so each block only has to be 
+// reduced by the existing pivots and a block leaving no kernel is dropped 
+// without touching it. The state before each block is saved to checkpoint 
+// when it is due. Blocks are reduced to rref with nthreads threads. With 
+// speculate, the next nthreads blocks are instead reduced at once, one per 
+// thread, by the pivots of submat before the first of them; each is then 
+// only reduced by the rows kept from the blocks before it, which leaves the 
+// rref the serial loop would compute.
+int reduce_kernel(nmod_mat_t den, nmod_mat_t kernel, nmod_mat_t submat, 
+    int i, ulong offset, bool fold, NTRUKeyGen& ctx, Checkpoint * checkpoint,
+    int nthreads = 1, bool speculate = false) {
+  int n = ctx.degree();
+  int q = ctx.q();
+  int d = ctx.coeffs();
+  int ncols = nmod_mat_nrows(kernel);
+  int status = 0;
+  std::vector<ulong> bins = binomials(n, d-1);
+
+  // pivots[j] is the pivot column of row j of submat
+  std::vector<slong> pivots;
+  nmod_mat_t window, temp, block, R;
+  slong r = nmod_mat_rref_parallel(submat, nthreads);
+  for (slong j = 0; j < r; j++) {
+    slong c = 0;
+    while (nmod_mat_entry(submat, j, c) == 0) {
+      c++;
+    }
+    pivots.push_back(c);
+  }
+  nmod_mat_window_init(window, submat, 0, 0, r, n);
+  nmod_mat_init_set(temp, window);
+  nmod_mat_window_clear(window);
+  nmod_mat_swap(submat, temp);
+  nmod_mat_clear(temp);
+
+  // blocks i, ..., ahead - 1 are spec[i - behind], reduced by the first 
+  // known rows of submat and to rref, with rank spec_rank[i - behind]
+  std::vector<nmod_mat_struct> spec;
+  std::vector<slong> spec_rank;
+  int behind = i, ahead = i;
+  slong known = 0;
+  int width = speculate ? std::min(nthreads, n - i) : 1;
+
+  int rank = n - r;
+  for (int first = i; i < n; i++) {
+    if (checkpoint && (i == first || checkpoint->due())) {
+      checkpoint->save_reduction(i, offset, kernel, submat);
+    }
+
+    if (width <= 1) {
+      nmod_mat_init(block, bins[i], n, q);
+      kernel_block(block, kernel, i, offset, fold);
+      if (!pivots.empty()) {
+        nmod_mat_reduce_pivots(block, pivots, submat);
+      }
+      r = nmod_mat_rref_parallel(block, nthreads);
+    } else {
+      if (i == ahead) {
+        behind = i;
+        ahead = std::min(n, i + width);
+        known = nmod_mat_nrows(submat);
+        spec.resize(ahead - behind);
+        spec_rank.resize(ahead - behind);
+        TaskGraph graph;
+        ulong o = offset;
+        for (int j = behind; j < ahead; o += bins[j] - fold, j++) {
+          graph.add([&, j, o]() {
+            nmod_mat_struct * B = &spec[j - behind];
+            nmod_mat_init(B, bins[j], n, q);
+            kernel_block(B, kernel, j, o, fold);
+            if (!pivots.empty()) {
+              nmod_mat_reduce_pivots(B, pivots, submat);
+            }
+            spec_rank[j - behind] = nmod_mat_rref(B);
+          });
+        }
+        graph.run(nthreads);
+      }
+
+      // block takes over the speculative block, which is cleared with it
+      *block = spec[i - behind];
+      r = spec_rank[i - behind];
+      if (nmod_mat_nrows(submat) > known) {
+        std::vector<slong> cols(pivots.begin() + known, pivots.end());
+        nmod_mat_window_init(R, submat, known, 0, nmod_mat_nrows(submat), n);
+        if (nmod_mat_reduce_pivots(block, cols, R)) {
+          r = nmod_mat_rref(block);
+        }
+        nmod_mat_window_clear(R);
+      }
+    }
+    rank = n - nmod_mat_nrows(submat) - r;
+    debug("New kernel rank: ", rank, "\n");
+
+    if (rank > 0 && r > 0) {
+      std::vector<slong> cols;
+      for (slong j = 0; j < r; j++) {
+        slong c = 0;
+        while (nmod_mat_entry(block, j, c) == 0) {
+          c++;
+        }
+        cols.push_back(c);
+      }
+      nmod_mat_window_init(R, block, 0, 0, r, n);
+      if (!pivots.empty()) {
+        nmod_mat_reduce_pivots(submat, cols, R);
+      }
+      nmod_mat_init(temp, nmod_mat_nrows(submat) + r, n, q);
+      nmod_mat_concat_vertical(temp, submat, R);
+      nmod_mat_swap(submat, temp);
+      nmod_mat_clear(temp);
+      nmod_mat_window_clear(R);
+      pivots.insert(pivots.end(), cols.begin(), cols.end());
+    }
+    nmod_mat_clear(block);
+    if (rank == 1) {
+      break;
+    }
+    offset += bins[i] - fold;
+  }
+
+  // the speculative blocks after the one the loop stopped at
+  for (int j = i + 1; j < ahead; j++) {
+    nmod_mat_clear(&spec[j - behind]);
+  }
+
+  if (rank != 1) {
+    debug("FAILURE: Reason unknown.\n");
+    status = 1;
+  }
+
+  // the first kernel vector of submat, as nmod_mat_nullspace would return 
+  // it, is 1 in the first non-pivot column; it is zero if the last block 
+  // left no kernel
+  nmod_mat_t res;
+  nmod_mat_init(res, n, 1, q);
+  if (rank > 0) {
+    std::vector<uint8_t> is_pivot(n, 0);
+    for (slong c : pivots) {
+      is_pivot[c] = 1;
+    }
+    slong f = 0;
+    while (is_pivot[f]) {
+      f++;
+    }
+    nmod_mat_entry(res, f, 0) = 1;
+    for (size_t j = 0; j < pivots.size(); j++) {
+      nmod_mat_entry(res, pivots[j], 0) = 
+        nmod_neg(nmod_mat_entry(submat, j, f), res->mod);
+    }
+  }
+
+  nmod_mat_init(temp, ncols, 1, q);
+  nmod_mat_mul(temp, kernel, res);
+
+  nmod_mat_window_init(window, temp, 0, 0, n, 1);
+  nmod_mat_transpose(den, window);
+  nmod_mat_window_clear(window);
+
+  nmod_mat_clear(res);
+  nmod_mat_clear(temp);
+  
+  return status;
+}
+
+int arora_ge_recover(nmod_mat_t den, nmod_mat_t system, NTRUKeyGen& ctx, 
+    bool cyclic, int compress, int nthreads, bool speculate) {
+  set_log_level(ctx.log_level());
+
+  int n = ctx.degree();
+  int q = ctx.q();
+  int ncols = nmod_mat_ncols(system);
+
+  // a kernel of rank above n is a failure, so the kernel is only computed 
+  // up to that rank
+  nmod_mat_t initial_kernel;
+  slong rank = -1;
+  if (cyclic) {
+    nmod_mat_init(initial_kernel, ncols, n + 1, q);
+    rank = arora_ge_nullspace_cyclic(initial_kernel, system, ctx);
+    if (rank < 0) {
+      debug("System is not cyclic, using full elimination.\n");
+      nmod_mat_clear(initial_kernel);
+    }
+  }
+  if (rank < 0 && compress >= 0) {
+    arora_ge_nullspace_compressed(initial_kernel, rank, system, n, compress,
+        ctx, nthreads);
+  } else if (rank < 0) {
+    nmod_mat_nullspace_capped(initial_kernel, rank, system, n, nthreads);
+  }
+
+  int status = arora_ge_recover_kernel(den, initial_kernel, rank, ctx, 
+      nullptr, nthreads, speculate);
+  nmod_mat_clear(initial_kernel);
+  return status;
+}
+
+int arora_ge_recover_blackbox(nmod_mat_t den, nmod_mat_t H_mat, 
+    NTRUKeyGen& ctx, bool fold) {
+  set_log_level(ctx.log_level());
+
+  // a kernel of rank above n is a failure, so one more column is enough
+  int n = ctx.degree();
+  nmod_mat_t initial_kernel;
+  nmod_mat_init(initial_kernel, num_variables(n, ctx.coeffs(), fold), n + 1,
+      ctx.q());
+  int rank = arora_ge_nullspace_blackbox(initial_kernel, H_mat, ctx, fold);
+
+  int status = arora_ge_recover_kernel(den, initial_kernel, rank, ctx);
+  nmod_mat_clear(initial_kernel);
+  return status;
+}
+
+int arora_ge_recover_tree(nmod_mat_t den, nmod_mat_t H_mat, NTRUKeyGen& ctx,
+    bool fold, int nthreads) {
+  set_log_level(ctx.log_level());
+
+  int n = ctx.degree();
+  nmod_mat_t initial_kernel;
+  slong rank;
+  arora_ge_nullspace_tree(initial_kernel, rank, H_mat, ctx, n, nthreads, fold);
+
+  int status = arora_ge_recover_kernel(den, initial_kernel, rank, ctx, 
+      nullptr, nthreads);
+  nmod_mat_clear(initial_kernel);
+  return status;
+}
+
+int arora_ge_recover_tiled(nmod_mat_t den, TiledMatrix& system, 
+    NTRUKeyGen& ctx) {
+  set_log_level(ctx.log_level());
+
+  int n = ctx.degree();
+  nmod_mat_t initial_kernel;
+  nmod_mat_init(initial_kernel, system.ncols(), n + 1, ctx.q());
+  int rank = arora_ge_nullspace_tiled(initial_kernel, system);
+
+  int status = arora_ge_recover_kernel(den, initial_kernel, rank, ctx);
+  nmod_mat_clear(initial_kernel);
+  return status;
+}
+
+int arora_ge_recover_checkpointed(nmod_mat_t den, nmod_mat_t system, 
+    NTRUKeyGen& ctx, Checkpoint& checkpoint, bool resume, int nthreads, 
+    bool speculate) {
+  set_log_level(ctx.log_level());
+
+  int n = ctx.degree();
+  int ncols = nmod_mat_ncols(system);
+  bool fold = ((ulong) ncols == num_variables(n, ctx.coeffs(), true));
+  checkpoint.set_system(system);
+  if (resume && checkpoint.stage() == Checkpoint::REDUCTION) {
+    int i;
+    ulong offset;
+    nmod_mat_t kernel, submat;
+    checkpoint.load_reduction(i, offset, kernel, submat, ctx.q(), n);
+    int status = reduce_kernel(den, kernel, submat, i, offset, fold, ctx, 
+        &checkpoint, nthreads, speculate);
+    nmod_mat_clear(kernel);
+    nmod_mat_clear(submat);
+    return status;
+  }
+
+  nmod_mat_t initial_kernel;
+  nmod_mat_init(initial_kernel, ncols, n + 1, ctx.q());
+  int rank = arora_ge_nullspace_checkpointed(initial_kernel, system, 
+      checkpoint, resume, nthreads);
+
+  int status = arora_ge_recover_kernel(den, initial_kernel, rank, ctx, 
+      &checkpoint, nthreads, speculate);
+  nmod_mat_clear(initial_kernel);
+  return status;
+}
+
+template <typename T>
+int arora_ge_recover_packed(nmod_mat_t den, PackedMatrix<T>& system, 
+    NTRUKeyGen& ctx) {
+  set_log_level(ctx.log_level());
+
+  int n = ctx.degree();
+  nmod_mat_t initial_kernel;
+  slong rank;
+  packed_nullspace(initial_kernel, rank, system, n);
+
+  int status = arora_ge_recover_kernel(den, initial_kernel, rank, ctx);
+  nmod_mat_clear(initial_kernel);
+  return status;
+}
+
+template int arora_ge_recover_packed(nmod_mat_t, PackedMatrix<uint16_t>&,
+    NTRUKeyGen&);
+template int arora_ge_recover_packed(nmod_mat_t, PackedMatrix<uint32_t>&,
+    NTRUKeyGen&);
+
+int arora_ge_recover_kernel(nmod_mat_t den, nmod_mat_t initial_kernel, 
+    slong rank, NTRUKeyGen& ctx, Checkpoint * checkpoint, int nthreads, 
+    bool speculate) {
   set_log_level(ctx.log_level());
 
   //int n = 31;
   int n = ctx.degree();
   int q = ctx.q();
   int d = ctx.coeffs();
-  int ncols = nmod_mat_ncols(system);
+  int ncols = nmod_mat_nrows(initial_kernel);
   int status = 0;
 
+  // the system has n fewer columns if it was built with folded columns
+  bool fold = ((ulong) ncols == num_variables(n, d, true));
   std::vector<ulong> bins = binomials(n, d-1);
-    
-  nmod_mat_t initial_kernel, window;
-  nmod_mat_init(initial_kernel, ncols, ncols, q);
-  int rank = nmod_mat_nullspace(initial_kernel, system);
-      
+
+  nmod_mat_t window;
+
   debug("Initial kernel rank: ", rank, "\n");
 
   bool terminate = false;
@@ -53,7 +514,6 @@ int arora_ge_recover(nmod_mat_t den, nmod_mat_t system, NTRUKeyGen& ctx) {
   }
   
   if (terminate) {
-    nmod_mat_clear(initial_kernel);
     return status;
   }
   
@@ -62,14 +522,21 @@ int arora_ge_recover(nmod_mat_t den, nmod_mat_t system, NTRUKeyGen& ctx) {
   nmod_mat_window_init(window, initial_kernel, 0, 0, ncols, n);
   nmod_mat_init_set(kernel, window);
   nmod_mat_window_clear(window);
-  nmod_mat_clear(initial_kernel);
+
+  if (kernel_readout(den, kernel, fold, ctx) == 0) {
+    debug("SUCCESS: Read a rotation of the denominator off the kernel.\n");
+    nmod_mat_clear(kernel);
+    return 0;
+  }
+  debug("Kernel readout failed, reducing kernel blocks.\n");
 
   int offset = n;
-  nmod_mat_t res;
-  nmod_mat_window_init(window, kernel, offset, 0, offset+bins[0], n);
-  nmod_mat_init(res, n, ncols, q);
+  nmod_mat_t res, block;
+  nmod_mat_init(block, bins[0], n, q);
+  kernel_block(block, kernel, 0, offset, fold);
+  nmod_mat_init(res, n, n, q);
   
-  rank = nmod_mat_nullspace(res, window);
+  rank = nmod_mat_nullspace(res, block);
   debug("New kernel rank: ", rank, "\n");
   int hw = n - rank;
   debug("Denominator hamming weight: ", hw, "\n");
@@ -82,7 +549,6 @@ int arora_ge_recover(nmod_mat_t den, nmod_mat_t system, NTRUKeyGen& ctx) {
     debug("SUCCESS: Denominator has hamming weight n - 1.\n");
     terminate = true;
 
-    nmod_mat_window_clear(window); 
     nmod_mat_window_init(window, res, 0, 0, n, 1);
   
     nmod_mat_init(temp, ncols, 1, q);
@@ -91,75 +557,34 @@ int arora_ge_recover(nmod_mat_t den, nmod_mat_t system, NTRUKeyGen& ctx) {
     nmod_mat_window_clear(window);
     nmod_mat_window_init(window, temp, 0, 0, n, 1);
     nmod_mat_transpose(den, window);
+    nmod_mat_window_clear(window);
     nmod_mat_clear(temp);
   }
   
   if (terminate) {
     nmod_mat_clear(res);
     nmod_mat_clear(kernel);
-    nmod_mat_window_clear(window);
+    nmod_mat_clear(block);
     return status;
   }
 
   nmod_mat_t submat;
-  nmod_mat_init_set(submat, window);
-  nmod_mat_init(temp, 0, 0, q);
-
-  offset += bins[0];
-  for (int i = 1; i < n; i++) {
-    nmod_mat_window_clear(window);
-    nmod_mat_window_init(window, kernel, offset, 0, offset+bins[i], n);
-    
-    nmod_mat_clear(temp);
-    //nmod_mat_init(temp, offset+bins[i]-n, n, q);
-    nmod_mat_init(temp, nmod_mat_nrows(submat) + nmod_mat_nrows(window), n, q);
-    nmod_mat_concat_vertical(temp, submat, window);
-
-    rank = nmod_mat_nullspace(res, temp);
-    debug("New kernel rank: ", rank, "\n");
-
-    if (rank > 0) {
-      nmod_mat_clear(submat);
-      nmod_mat_init_set(submat, temp);
-      if (rank == 1) {
-        break;
-      }
-    }
-    offset += bins[i];
-  }
-
-  if (rank != 1) {
-    debug("FAILURE: Reason unknown.\n");
-    status = 1;
-  }
-
-  nmod_mat_window_clear(window); 
-  nmod_mat_window_init(window, res, 0, 0, n, 1);
-  
-  nmod_mat_clear(temp);
-  nmod_mat_init(temp, ncols, 1, q);
-  nmod_mat_mul(temp, kernel, window);
-
-  nmod_mat_window_clear(window);
-  nmod_mat_window_init(window, temp, 0, 0, n, 1);
-  nmod_mat_transpose(den, window);
-
+  nmod_mat_init_set(submat, block);
   nmod_mat_clear(res);
+  nmod_mat_clear(block);
+
+  offset += bins[0] - fold;
+  status = reduce_kernel(den, kernel, submat, 1, offset, fold, ctx, 
+      checkpoint, nthreads, speculate);
   nmod_mat_clear(kernel);
-  nmod_mat_clear(temp);
   nmod_mat_clear(submat);
-  nmod_mat_window_clear(window);
-  
   return status;
 }
 
-
-int arora_ge_recover_nullonly(nmod_mat_t ker, nmod_mat_t system) {
-  auto t0 = high_resolution_clock::now();  
-  nmod_mat_nullspace(ker, system);
+// Print the time taken since t0 and the resident memory.
+void print_usage(high_resolution_clock::time_point t0) {
   auto t1 = high_resolution_clock::now();
   auto duration = duration_cast<microseconds>(t1-t0);
-  //nmod_mat_print(ker);
   
   int tSize = 0, resident = 0, share = 0;
   ifstream buffer("/proc/self/statm");
@@ -169,6 +594,27 @@ int arora_ge_recover_nullonly(nmod_mat_t ker, nmod_mat_t system) {
   double rss = resident * page_size_kb;
 
   std::cout << "# mem: " << rss/1000.0 << " M," << " time: " << duration.count()/1000000.0 << " s" << endl;
+}
+
+int arora_ge_recover_nullonly(nmod_mat_t ker, nmod_mat_t system, 
+    int nthreads) {
+  auto t0 = high_resolution_clock::now();  
+  slong rank;
+  nmod_mat_nullspace_capped(ker, rank, system, nmod_mat_ncols(system), 
+      nthreads);
+  //nmod_mat_print(ker);
+  print_usage(t0);
+  return 0;
+}
 
+template <typename T>
+int arora_ge_recover_nullonly(nmod_mat_t ker, PackedMatrix<T>& system) {
+  auto t0 = high_resolution_clock::now();  
+  slong rank;
+  packed_nullspace(ker, rank, system, system.ncols());
+  print_usage(t0);
   return 0;
-}
\ No newline at end of file
+}
+
+template int arora_ge_recover_nullonly(nmod_mat_t, PackedMatrix<uint16_t>&);
+template int arora_ge_recover_nullonly(nmod_mat_t, PackedMatrix<uint32_t>&);
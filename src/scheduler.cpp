@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "scheduler.hpp"
+
+namespace {
+
+// Ready tasks of one thread; the owner works at the back and thieves take
+// from the front.
+struct ReadyQueue {
+  std::mutex mutex;
+  std::deque<size_t> tasks;
+
+  void push(size_t task) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->tasks.push_back(task);
+  }
+
+  bool pop(size_t& task) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->tasks.empty()) {
+      return false;
+    }
+    task = this->tasks.back();
+    this->tasks.pop_back();
+    return true;
+  }
+
+  bool steal(size_t& task) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->tasks.empty()) {
+      return false;
+    }
+    task = this->tasks.front();
+    this->tasks.pop_front();
+    return true;
+  }
+};
+
+}
+
+size_t TaskGraph::add(std::function<void()> task) {
+  this->tasks_.push_back(std::move(task));
+  this->successors_.emplace_back();
+  this->dependencies_.push_back(0);
+  return this->tasks_.size() - 1;
+}
+
+void TaskGraph::depend(size_t task, size_t before) {
+  this->successors_[before].push_back(task);
+  this->dependencies_[task]++;
+}
+
+void TaskGraph::run(int nthreads) {
+  size_t ntasks = this->tasks_.size();
+  nthreads = std::max(1, nthreads);
+
+  std::unique_ptr<std::atomic<int>[]> pending(new std::atomic<int>[ntasks]);
+  std::vector<ReadyQueue> queues(nthreads);
+  for (size_t t = 0, w = 0; t < ntasks; t++) {
+    pending[t] = this->dependencies_[t];
+    if (this->dependencies_[t] == 0) {
+      queues[w++ % nthreads].tasks.push_back(t);
+    }
+  }
+
+  std::atomic<size_t> unfinished(ntasks);
+  std::atomic<bool> failed(false);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  auto worker = [&](int id) {
+    size_t t;
+    while (unfinished > 0 && !failed) {
+      bool found = queues[id].pop(t);
+      for (int k = 1; !found && k < nthreads; k++) {
+        found = queues[(id + k) % nthreads].steal(t);
+      }
+      if (!found) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      try {
+        this->tasks_[t]();
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        failed = true;
+      }
+      for (size_t s : this->successors_[t]) {
+        if (--pending[s] == 0) {
+          queues[id].push(s);
+        }
+      }
+      unfinished--;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < nthreads; i++) {
+    threads.emplace_back(worker, i);
+  }
+  worker(0);
+  for (auto& t : threads) {
+    t.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
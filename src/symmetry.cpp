@@ -0,0 +1,313 @@
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <flint.h>
+#include <nmod.h>
+#include <nmod_poly.h>
+#include <nmod_mat.h>
+
+#include "symmetry.hpp"
+#include "system.hpp"
+#include "monomials.hpp"
+#include "extras.hpp"
+#include "logging.hpp"
+
+namespace {
+
+// An orbit c_0, ..., c_{s-1} of the rotation T on the columns, with
+// T e_{c_m} = +-e_{c_{m+1}}. In the basis u_m = T^m e_{c_0}, which is e_{c_m}
+// negated when negate[m] is set, T is the cyclic shift with T u_{s-1} equal
+// to u_0, negated when negated is set.
+struct Orbit {
+  std::vector<slong> cols;
+  std::vector<uint8_t> negate;
+  bool negated;
+};
+
+// Rotation of the columns: row j + 1 of a key's block has entry c equal to
+// entry perm[c] of row j, negated when negate[c] is set. Returns false if
+// folding is inconsistent with the signs, as for ring 2 and even d.
+bool column_rotation(std::vector<slong>& perm, std::vector<uint8_t>& negate,
+    int n, int d, bool negacyclic, bool fold) {
+  MonomialTable table(n, d);
+  std::vector<uint32_t> map;
+  std::vector<uint8_t> mono_negate;
+  table.rotation(map, mono_negate, negacyclic);
+
+  ulong ncols = num_variables(n, d, fold);
+  perm.resize(ncols);
+  negate.assign(ncols, 0);
+  for (int c = 0; c < n; c++) {
+    perm[c] = (c + n - 1) % n;
+  }
+  negate[0] = negacyclic;
+
+  // with fold, x_a^d is column a, so its sign must agree with x_a's
+  for (ulong k = 0; k < table.size(); k++) {
+    slong c = table.column(k, fold);
+    if (c < n) {
+      if (negate[c] != mono_negate[k]) {
+        return false;
+      }
+      continue;
+    }
+    perm[c] = table.column(map[k], fold);
+    negate[c] = mono_negate[k];
+  }
+  return true;
+}
+
+// Check that every row of the system after the first of each key's block is
+// the rotation of the row before it.
+bool rotation_invariant(nmod_mat_t system, const std::vector<slong>& perm,
+    const std::vector<uint8_t>& negate, int n, nmod_t mod) {
+  slong nrows = nmod_mat_nrows(system);
+  slong ncols = nmod_mat_ncols(system);
+  for (slong i = 0; i < nrows; i++) {
+    if (i % n == 0) {
+      continue;
+    }
+    for (slong c = 0; c < ncols; c++) {
+      mp_limb_t x = nmod_mat_entry(system, i - 1, perm[c]);
+      if (negate[c]) {
+        x = nmod_neg(x, mod);
+      }
+      if (nmod_mat_entry(system, i, c) != x) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+std::vector<Orbit> column_orbits(const std::vector<slong>& perm,
+    const std::vector<uint8_t>& negate) {
+  // T e_c = +-e_{perm[c]}, negated when negate[c] is set
+  slong ncols = perm.size();
+  std::vector<Orbit> orbits;
+  std::vector<uint8_t> seen(ncols, 0);
+  for (slong c0 = 0; c0 < ncols; c0++) {
+    if (seen[c0]) {
+      continue;
+    }
+    Orbit orbit;
+    bool sign = false;
+    slong c = c0;
+    do {
+      seen[c] = 1;
+      orbit.cols.push_back(c);
+      orbit.negate.push_back(sign);
+      sign ^= negate[c];
+      c = perm[c];
+    } while (c != c0);
+    orbit.negated = sign;
+    orbits.push_back(orbit);
+  }
+  return orbits;
+}
+
+// Kernel of the system restricted to the kernel of f(T), for an irreducible
+// factor f of degree e. On an orbit of size s, that kernel is spanned by
+// w, T w, ..., T^{e-1} w for w = g(T) u_0, where g = (x^s -+ 1) / f, or is
+// zero when f does not divide x^s -+ 1. Since f(T) vanishes there, a vector
+// in it is in the kernel when it is orthogonal to the first e rows of each
+// key's block, and the entry of row j for T^m w is the first row times
+// T^{j+m} w. The kernel is written, in the original columns, to columns
+// offset, offset + 1, ... of X. Returns its dimension.
+slong factor_kernel(nmod_mat_t X, slong offset, nmod_mat_t system,
+    const std::vector<Orbit>& orbits, nmod_poly_t f, int n, nmod_t mod) {
+  slong e = nmod_poly_degree(f);
+  slong nkeys = nmod_mat_nrows(system) / n;
+
+  // cofactor g for each orbit size and sign, empty if f does not divide
+  std::map<std::pair<slong, bool>, std::vector<mp_limb_t>> cofactors;
+  std::vector<const Orbit *> used;
+  std::vector<const std::vector<mp_limb_t> *> used_g;
+  nmod_poly_t p, g, r;
+  nmod_poly_init_mod(p, mod);
+  nmod_poly_init_mod(g, mod);
+  nmod_poly_init_mod(r, mod);
+  for (const Orbit& orbit : orbits) {
+    slong s = orbit.cols.size();
+    auto key = std::make_pair(s, orbit.negated);
+    auto it = cofactors.find(key);
+    if (it == cofactors.end()) {
+      std::vector<mp_limb_t> coeffs;
+      nmod_poly_zero(p);
+      nmod_poly_set_coeff_ui(p, s, 1);
+      nmod_poly_set_coeff_ui(p, 0, orbit.negated ? 1 : mod.n - 1);
+      nmod_poly_divrem(g, r, p, f);
+      if (nmod_poly_is_zero(r)) {
+        coeffs.assign(s, 0);
+        for (slong m = 0; m <= nmod_poly_degree(g); m++) {
+          coeffs[m] = nmod_poly_get_coeff_ui(g, m);
+        }
+      }
+      it = cofactors.emplace(key, coeffs).first;
+    }
+    if (!it->second.empty()) {
+      used.push_back(&orbit);
+      used_g.push_back(&it->second);
+    }
+  }
+  nmod_poly_clear(p);
+  nmod_poly_clear(g);
+  nmod_poly_clear(r);
+
+  slong ncols = e*used.size();
+  if (ncols == 0) {
+    return 0;
+  }
+
+  // h = x h mod x^s -+ 1
+  auto shift = [&](std::vector<mp_limb_t>& h, bool negated) {
+    mp_limb_t top = h.back();
+    for (slong m = h.size() - 1; m > 0; m--) {
+      h[m] = h[m-1];
+    }
+    h[0] = negated ? nmod_neg(top, mod) : top;
+  };
+
+  nmod_mat_t M;
+  nmod_mat_init(M, nkeys*e, ncols, mod.n);
+  std::vector<mp_limb_t> row, hankel(2*e - 1);
+  for (size_t o = 0; o < used.size(); o++) {
+    const Orbit& orbit = *used[o];
+    slong s = orbit.cols.size();
+    for (slong k = 0; k < nkeys; k++) {
+      // first row of the key in the basis u_m
+      row.resize(s);
+      for (slong m = 0; m < s; m++) {
+        row[m] = nmod_mat_entry(system, k*n, orbit.cols[m]);
+        if (orbit.negate[m]) {
+          row[m] = nmod_neg(row[m], mod);
+        }
+      }
+      std::vector<mp_limb_t> h = *used_g[o];
+      for (slong l = 0; l < 2*e - 1; l++) {
+        mp_limb_t x = 0;
+        for (slong m = 0; m < s; m++) {
+          x = nmod_add(x, nmod_mul(row[m], h[m], mod), mod);
+        }
+        hankel[l] = x;
+        shift(h, orbit.negated);
+      }
+      for (slong j = 0; j < e; j++) {
+        for (slong m = 0; m < e; m++) {
+          nmod_mat_entry(M, k*e + j, o*e + m) = hankel[j + m];
+        }
+      }
+    }
+  }
+
+  nmod_mat_t K;
+  nmod_mat_init(K, ncols, ncols, mod.n);
+  slong rank = nmod_mat_nullspace(K, M);
+  if (offset + rank > nmod_mat_ncols(X)) {
+    nmod_mat_clear(M);
+    nmod_mat_clear(K);
+    return rank;
+  }
+
+  // kernel vector y is sum_m y_{o,m} T^m w_o over the orbits
+  for (size_t o = 0; o < used.size(); o++) {
+    const Orbit& orbit = *used[o];
+    slong s = orbit.cols.size();
+    std::vector<mp_limb_t> h = *used_g[o];
+    for (slong m = 0; m < e; m++) {
+      for (slong t = 0; t < rank; t++) {
+        mp_limb_t y = nmod_mat_entry(K, o*e + m, t);
+        if (y == 0) {
+          continue;
+        }
+        for (slong i = 0; i < s; i++) {
+          mp_limb_t x = nmod_mul(y, h[i], mod);
+          if (orbit.negate[i]) {
+            x = nmod_neg(x, mod);
+          }
+          mp_limb_t& entry = nmod_mat_entry(X, orbit.cols[i], offset + t);
+          entry = nmod_add(entry, x, mod);
+        }
+      }
+      shift(h, orbit.negated);
+    }
+  }
+
+  nmod_mat_clear(M);
+  nmod_mat_clear(K);
+  return rank;
+}
+
+}
+
+bool arora_ge_column_rotation(std::vector<slong>& perm,
+    std::vector<uint8_t>& negate, const NTRUKeyGen& ctx, bool fold) {
+  int n = ctx.degree();
+  int r = ctx.ring();
+  bool negacyclic = (r == 2);
+  if ((r != 1 && r != 2) ||
+      !column_rotation(perm, negate, n, ctx.coeffs(), negacyclic, fold)) {
+    return false;
+  }
+
+  // T^n = -1 on every orbit for the negacyclic ring, but the monomials of
+  // even degree are not negated, so that case has no symmetry to use
+  for (const Orbit& orbit : column_orbits(perm, negate)) {
+    slong s = orbit.cols.size();
+    if ((orbit.negated && (n/s) % 2 == 1) != negacyclic) {
+      return false;
+    }
+  }
+  return true;
+}
+
+slong arora_ge_nullspace_cyclic(nmod_mat_t X, nmod_mat_t system,
+    const NTRUKeyGen& ctx) {
+  int n = ctx.degree();
+  int d = ctx.coeffs();
+  nmod_t mod = ctx.q_nmod();
+  slong nrows = nmod_mat_nrows(system);
+  ulong ncols = nmod_mat_ncols(system);
+
+  // x^n -+ 1 must be squarefree
+  if (nrows % n != 0 || n % mod.n == 0) {
+    return -1;
+  }
+  bool fold = (ncols == num_variables(n, d, true));
+  if (!fold && ncols != num_variables(n, d)) {
+    return -1;
+  }
+
+  std::vector<slong> perm;
+  std::vector<uint8_t> negate;
+  if (!arora_ge_column_rotation(perm, negate, ctx, fold) ||
+      !rotation_invariant(system, perm, negate, n, mod)) {
+    return -1;
+  }
+  std::vector<Orbit> orbits = column_orbits(perm, negate);
+  bool negacyclic = (ctx.ring() == 2);
+
+  nmod_poly_t f;
+  nmod_poly_init_mod(f, mod);
+  nmod_poly_set_coeff_ui(f, n, 1);
+  nmod_poly_set_coeff_ui(f, 0, negacyclic ? 1 : mod.n - 1);
+  nmod_poly_factor_t factors;
+  nmod_poly_factor_init(factors);
+  nmod_poly_factor(factors, f);
+  int nfactors = factors->num;
+  debug("Splitting system into ", nfactors, " blocks.\n");
+
+  nmod_mat_zero(X);
+  slong rank = 0;
+  for (slong i = 0; i < factors->num && rank <= nmod_mat_ncols(X); i++) {
+    rank += factor_kernel(X, rank, system, orbits, factors->p + i, n, mod);
+  }
+  if (rank <= nmod_mat_ncols(X)) {
+    nmod_mat_nullspace_canonical(X, rank);
+  }
+
+  nmod_poly_factor_clear(factors);
+  nmod_poly_clear(f);
+  return rank;
+}
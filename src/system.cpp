@@ -2,7 +2,9 @@
 #include <cassert>
 #include <iostream>
 #include <algorithm>
+#include <atomic>
 #include <sstream>
+#include <thread>
 
 #include <flint.h>
 #include <nmod.h>
@@ -13,6 +15,8 @@
 #include "logging.hpp"
 #include "system.hpp"
 #include "extras.hpp"
+#include "kernels.hpp"
+#include "monomials.hpp"
 
 // Binomial coefficients n + k - i choose k for i = 1 to n.
 std::vector<ulong> binomials(ulong n, ulong k) {
@@ -24,288 +28,411 @@ std::vector<ulong> binomials(ulong n, ulong k) {
   return res;
 }
 
-ulong num_variables(int n, int mode) {
+// With fold, the monomials x_i^mode are identified with x_i by the field
+// equation of the coefficients (x^2 = x for binary, x^3 = x for ternary), 
+// removing n columns.
+ulong num_variables(int n, int mode, bool fold) {
   ulong res = bin_uiui((ulong)(n + mode - 1), (ulong)mode) + n;
+  if (fold) {
+    res -= n;
+  }
   return res;
 }
 
-// Set mat to multiplication matrix of h in Z_q[x]/(mod)
+// Minimum number of keys (each contributing n rows) such that the system has
+// at least num_variables(n, mode) + epsilon rows, capped at nkeys. With 
+// epsilon = 1 this is the early abort rule of the Sage implementation, which
+// is too few when some keys are repeated or rotations of each other, as is
+// common for small n; the apps default to epsilon = num_variables(n, mode).
+int num_keys(int n, int mode, int nkeys, int epsilon, bool fold) {
+  ulong nrows = num_variables(n, mode, fold) + std::max(epsilon, 0);
+  ulong needed = (nrows + n - 1) / n;
+  return (int) std::min((ulong) nkeys, needed);
+}
+
+// Set mat to multiplication matrix of h in Z_q[x]/(mod). Column i + 1 is 
+// x times column i: the column is shifted down by one and the coefficient
+// pushed out of the top is reduced against the nonzero terms of the 
+// (sparse, monic) modulus, so each column costs O(n) operations.
 void multiplication_matrix(nmod_mat_t mat, nmod_poly_t h, const NTRUKeyGen& keygen) {
   int n = keygen.degree();
+  nmod_t mod = keygen.q_nmod();
   assert(nmod_mat_ncols(mat) == n);
   assert(nmod_mat_nrows(mat) == n);
+  assert(nmod_poly_degree(keygen.modulus) == n);
+
+  // nonzero terms of x^n - modulus, i.e. the reduction of x^n
+  std::vector<int> terms;
+  std::vector<mp_limb_t> coeffs;
+  for (int k = 0; k < n; k++) {
+    mp_limb_t c = nmod_poly_get_coeff_ui(keygen.modulus, k);
+    if (c != 0) {
+      terms.push_back(k);
+      coeffs.push_back(nmod_neg(c, mod));
+    }
+  }
+
+  nmod_poly_t h_red;
+  nmod_poly_init_mod(h_red, mod);
+  nmod_poly_rem(h_red, h, keygen.modulus);
+  for (int j = 0; j < n; j++) {
+    nmod_mat_set_entry(mat, j, 0, nmod_poly_get_coeff_ui(h_red, j));
+  }
+  nmod_poly_clear(h_red);
 
-  nmod_poly_t x;
-  nmod_poly_init_mod(x, h->mod);
-  nmod_poly_set_coeff_ui(x, 1, 1);
-  
-  ulong c;
-  for (int i = 0; i < n; i++) {
-    for (int j =0; j < n; j++) {
-      c = nmod_poly_get_coeff_ui(h, j);
-      nmod_mat_set_entry(mat, j, i, c);
+  for (int i = 1; i < n; i++) {
+    mp_limb_t top = nmod_mat_entry(mat, n - 1, i - 1);
+    nmod_mat_entry(mat, 0, i) = 0;
+    for (int j = 1; j < n; j++) {
+      nmod_mat_entry(mat, j, i) = nmod_mat_entry(mat, j - 1, i - 1);
+    }
+    if (top != 0) {
+      for (size_t t = 0; t < terms.size(); t++) {
+        mp_limb_t& x = nmod_mat_entry(mat, terms[t], i);
+        x = nmod_add(x, nmod_mul(top, coeffs[t], mod), mod);
+      }
     }
-    nmod_poly_mul(h, h, x);
-    nmod_poly_rem(h, h, keygen.modulus);
   }
-  nmod_poly_clear(x);
 }
 
-void arora_ge_system(nmod_mat_t res, nmod_mat_t H_mat, const NTRUKeyGen& keygen) {
-  set_log_level(keygen.log_level());
+namespace {
 
-  int r = keygen.ring();
-  if (r == 1) {
-    arora_ge_system_ntru(res, H_mat, keygen);
-  } else if (r == 2) {
-    arora_ge_system_ntru2(res, H_mat, keygen);
-  } else {
-    arora_ge_system_generic(res, H_mat, keygen);
+// Ring policies: how the multiplication matrix of a key is formed, and 
+// whether its rows are (signed) rotations of each other.
+struct Cyclic {
+  static const bool rotates = true;
+  static const bool negacyclic = false;
+
+  static void multiplication_matrix(nmod_mat_t mult, nmod_mat_t H_mat, int key, 
+      const NTRUKeyGen& ctx) {
+    multiplication_matrix_ntru(mult, H_mat, key, ctx);
   }
+};
 
-}
+struct Negacyclic {
+  static const bool rotates = true;
+  static const bool negacyclic = true;
 
-int index(std::vector<int> comb) {
-  int d = comb.size();
-  int u = 0;
-  for (int i = 1; i < d; i++) {
-    if (comb[i-1] == comb[i]) {
-      u++;
-    } 
+  static void multiplication_matrix(nmod_mat_t mult, nmod_mat_t H_mat, int key, 
+      const NTRUKeyGen& ctx) {
+    multiplication_matrix_ntru2(mult, H_mat, key, ctx);
   }
-  return u;
-}
+};
 
-void arora_ge_system_ntru(nmod_mat_t res, nmod_mat_t H_mat, const NTRUKeyGen& ctx) {
-  int n = ctx.degree();
-  int d = ctx.coeffs();
-  int q = ctx.q();
-  int nkeys = nmod_mat_nrows(H_mat);
-  nmod_t q_nmod = ctx.q_nmod();
-  
-  std::vector<int> monomial_coeffs(d);
-  for (int i = 1; i <= d; i++) {
-    monomial_coeffs[i-1] = factorial(d, i);    
+struct SparseModulus {
+  static const bool rotates = false;
+  static const bool negacyclic = false;
+
+  static void multiplication_matrix(nmod_mat_t mult, nmod_mat_t H_mat, int key, 
+      const NTRUKeyGen& ctx) {
+    multiplication_matrix_generic(mult, H_mat, key, ctx);
   }
-  
-  int m = n + d - 1;
-  std::vector<bool> perm(m);
-  std::fill(perm.begin(), perm.begin() + d, true);
-
-  // Iterate over unique monomials.
-  int i, j, k, x, idx, n_unique;
-  std::vector<int> comb(d);
-  std::vector<std::vector<int>> combs;
-  std::vector<int> unique;
-
-  // precompute combinations:
-  do {
-    idx = 0;
-    n_unique = 0;
-    for (i = 0; i < m; ++i) {
-      if (perm[i]) {
-        comb[idx] = i - idx;
-        if (idx > 0 && comb[idx-1] == comb[idx]) {
-          n_unique++;
-        }
-        idx++;
-      }
-    }
-    combs.push_back(comb);
-    unique.push_back(n_unique);
-  } while (std::prev_permutation(perm.begin(), perm.end()));
+};
 
-  nmod_mat_t mult, window;  
-  nmod_mat_init(mult, n, n, q);
-  for (i = 0; i < nkeys; i++) {
-    // make multiplication matrix
-    for (j = 0; j < n; j++) {
-      x = nmod_mat_get_entry(H_mat, i, j);
-      for (k = 0; k < n; k++) {
-        nmod_mat_set_entry(mult, k, (k-j+n) % n, x);
+// Monomials of degree D of row, in column order. scaled[u*n + c] is row[c] 
+// times the multinomial coefficient of a monomial with u repeated indices,
+// which is applied with the last factor. D = 2 and D = 3 are unrolled, any 
+// other degree uses the generic walk of monomial_products.
+template <int D>
+inline void monomial_row(mp_limb_t * res, const mp_limb_t * row, 
+    const mp_limb_t * scaled, int n, int d, nmod_t mod) {
+  if constexpr (D == 2) {
+    const mp_limb_t * s2 = scaled;      // coefficient 2
+    for (int a = 0; a < n; a++) {
+      mp_limb_t pa = row[a];
+      *res++ = nmod_mul(pa, pa, mod);
+      for (int b = a + 1; b < n; b++) {
+        *res++ = nmod_mul(pa, s2[b], mod);
       }
     }
-
-    // set first block to negative of multiplication matrix
-    nmod_mat_window_init(window, res, n*i, 0, n*i+n, n);
-    nmod_mat_neg(window, mult);
-    nmod_mat_window_clear(window);
-
-    for (j = 0; j < n; j++) {
-      nmod_mat_window_init(window, mult, j, 0, j+1, n);
-      for (size_t k = 0; k < combs.size(); k++) {
-        comb = combs[k];
-        n_unique = unique[k];        
-      
-        x = power_product(window, comb);
-        x = nmod_mul(monomial_coeffs[n_unique], x, q_nmod);
-        nmod_mat_set_entry(res, n*i + j, n + k, x);
+  } else if constexpr (D == 3) {
+    const mp_limb_t * s6 = scaled;      // coefficient 6
+    const mp_limb_t * s3 = scaled + n;  // coefficient 3
+    for (int a = 0; a < n; a++) {
+      mp_limb_t pa = row[a];
+      mp_limb_t paa = nmod_mul(pa, pa, mod);
+      *res++ = nmod_mul(paa, pa, mod);
+      for (int c = a + 1; c < n; c++) {
+        *res++ = nmod_mul(paa, s3[c], mod);
+      }
+      for (int b = a + 1; b < n; b++) {
+        mp_limb_t pab = nmod_mul(pa, row[b], mod);
+        *res++ = nmod_mul(pab, s3[b], mod);
+        for (int c = b + 1; c < n; c++) {
+          *res++ = nmod_mul(pab, s6[c], mod);
+        }
       }
-      nmod_mat_window_clear(window);
     }
+  } else {
+    monomial_products(res, row, n, d, mod);
+  }
+}
+
+template <class Ring>
+void rotation_gather(RotationGather& gather, int n, int d) {
+  if constexpr (Ring::rotates) {
+    MonomialTable table(n, d);
+    table.rotation(gather.map, gather.negate, Ring::negacyclic);
   }
-  nmod_mat_clear(mult);
 }
 
-void arora_ge_system_ntru2(nmod_mat_t res, nmod_mat_t H_mat, const NTRUKeyGen& ctx) {
+// Rows start, ..., end - 1 of the given key. Given a rotation gather map, 
+// only the monomials of the first row are multiplied out and every other 
+// row is gathered from the one before it. With fold, the monomials are 
+// expanded into a scratch row and the pure powers are then added to the
+// linear columns.
+template <class Ring, int D>
+void system_rows(nmod_mat_t block, nmod_mat_t H_mat, int key, int start, 
+    int end, const NTRUKeyGen& ctx, const RotationGather& gather, bool fold) {
   int n = ctx.degree();
   int d = ctx.coeffs();
   int q = ctx.q();
-  int nkeys = nmod_mat_nrows(H_mat);
   nmod_t q_nmod = ctx.q_nmod();
-  
-  std::vector<int> monomial_coeffs(d);
-  for (int i = 1; i <= d; i++) {
-    monomial_coeffs[i-1] = factorial(d, i);    
+  assert(0 <= start && start <= end && end <= n);
+  assert(nmod_mat_nrows(block) == end - start);
+  assert((ulong) nmod_mat_ncols(block) == num_variables(n, d, fold));
+
+  nmod_mat_t mult;
+  nmod_mat_init(mult, n, n, q);
+  Ring::multiplication_matrix(mult, H_mat, key, ctx);
+
+  // first block is the negative of the multiplication matrix
+  for (int j = start; j < end; j++) {
+    for (int k = 0; k < n; k++) {
+      nmod_mat_entry(block, j - start, k) = 
+        nmod_neg(nmod_mat_entry(mult, j, k), q_nmod);
+    }
+  }
+
+  int direct = end;
+  if (Ring::rotates && !gather.map.empty()) {
+    direct = std::min(start + 1, end);
+  }
+
+  ulong nmonomials = bin_uiui(n + d - 1, d);
+  std::vector<mp_limb_t> scratch;
+  std::vector<ulong> pure;
+  if (fold) {
+    scratch.resize(2*nmonomials);
+    // position of x_a^d, after all monomials with a smaller first index
+    std::vector<ulong> bins = binomials(n, d - 1);
+    pure.resize(n);
+    for (int a = 1; a < n; a++) {
+      pure[a] = pure[a-1] + bins[a-1];
+    }
   }
-  
-  int m = n + d - 1;
-  std::vector<bool> perm(m);
-  std::fill(perm.begin(), perm.begin() + d, true);
-
-  // Iterate over unique monomials.
-  int i, j, k, x, y, idx, n_unique;
-  std::vector<int> comb(d);
-  std::vector<std::vector<int>> combs;
-  std::vector<int> unique;
-
-  // precompute combinations:
-  do {
-    idx = 0;
-    n_unique = 0;
-    for (i = 0; i < m; ++i) {
-      if (perm[i]) {
-        comb[idx] = i - idx;
-        if (idx > 0 && comb[idx-1] == comb[idx]) {
-          n_unique++;
+  auto monomials = [&](int j) -> mp_limb_t * {
+    if (fold) {
+      return scratch.data() + (j & 1)*nmonomials;
+    }
+    return &nmod_mat_entry(block, j - start, n);
+  };
+
+  // monomials of each row of the multiplication matrix, with the batched 
+  // SIMD kernel when q is small enough for 32-bit lanes
+  bool done = false;
+  if constexpr (D == 2 || D == 3) {
+    if (monomial_kernel_supported(q, D) && !fold) {
+      std::vector<uint32_t> rows((direct - start)*n);
+      std::vector<mp_limb_t *> out(direct - start);
+      for (int j = start; j < direct; j++) {
+        for (int k = 0; k < n; k++) {
+          rows[(j - start)*n + k] = nmod_mat_entry(mult, j, k);
         }
-        idx++;
+        out[j - start] = monomials(j);
       }
+      monomial_kernel_rows(out.data(), rows.data(), direct - start, n, D, q);
+      done = true;
     }
-    combs.push_back(comb);
-    unique.push_back(n_unique);
-  } while (std::prev_permutation(perm.begin(), perm.end()));
+  }
 
-  nmod_mat_t mult, window;  
-  nmod_mat_init(mult, n, n, q);
-  for (i = 0; i < nkeys; i++) {
-    // make multiplication matrix
-    for (j = 0; j < n; j++) {
-      x = nmod_mat_get_entry(H_mat, i, j);
-      for (k = 0; k < j; k++) {
-        y = nmod_neg(x, q_nmod);
-        nmod_mat_set_entry(mult, k, (k-j+n) % n, y);
-      }      
-      for (k = j; k < n; k++) {
-        nmod_mat_set_entry(mult, k, (k-j+n) % n, x);
+  std::vector<mp_limb_t> scaled(std::max(d - 1, 1)*n);
+  std::vector<uint32_t> row32(n);
+  for (int j = start; j < end; j++) {
+    mp_limb_t * out = monomials(j);
+
+    if (j < direct && !done) {
+      const mp_limb_t * row = &nmod_mat_entry(mult, j, 0);
+      if (monomial_kernel_supported(q, d)) {
+        for (int k = 0; k < n; k++) {
+          row32[k] = row[k];
+        }
+        monomial_kernel_rows(&out, row32.data(), 1, n, d, q);
+      } else {
+        for (int u = 0; u < d - 1; u++) {
+          mp_limb_t coeff = factorial(d, u + 1) % q_nmod.n;
+          for (int k = 0; k < n; k++) {
+            scaled[u*n + k] = nmod_mul(coeff, row[k], q_nmod);
+          }
+        }
+        monomial_row<D>(out, row, scaled.data(), n, d, q_nmod);
+      }
+    } else if (j >= direct) {
+      // rotation of the previous row
+      const uint32_t * map = gather.map.data();
+      const uint8_t * negate = gather.negate.data();
+      const mp_limb_t * prev = monomials(j - 1);
+      if (Ring::negacyclic) {
+        for (ulong k = 0; k < nmonomials; k++) {
+          mp_limb_t x = prev[map[k]];
+          out[k] = negate[k] ? nmod_neg(x, q_nmod) : x;
+        }
+      } else {
+        for (ulong k = 0; k < nmonomials; k++) {
+          out[k] = prev[map[k]];
+        }
       }
     }
 
-    // set first block to negative of multiplication matrix
-    nmod_mat_window_init(window, res, n*i, 0, n*i+n, n);
-    nmod_mat_neg(window, mult);
-    nmod_mat_window_clear(window);
-
-    for (j = 0; j < n; j++) {
-      nmod_mat_window_init(window, mult, j, 0, j+1, n);
-      for (size_t k = 0; k < combs.size(); k++) {
-        comb = combs[k];
-        n_unique = unique[k];        
-      
-        x = power_product(window, comb);
-        x = nmod_mul(monomial_coeffs[n_unique], x, q_nmod);
-        nmod_mat_set_entry(res, n*i + j, n + k, x);
+    if (fold) {
+      mp_limb_t * res = &nmod_mat_entry(block, j - start, 0);
+      ulong m = n;
+      int a = 0;
+      for (ulong k = 0; k < nmonomials; k++) {
+        if (a < n && k == pure[a]) {
+          res[a] = nmod_add(res[a], out[k], q_nmod);
+          a++;
+        } else {
+          res[m++] = out[k];
+        }
       }
-      nmod_mat_window_clear(window);
     }
   }
   nmod_mat_clear(mult);
 }
 
-void arora_ge_system_generic(nmod_mat_t res, nmod_mat_t H_mat, const NTRUKeyGen& ctx) {
-  //throw "arora_ge_system_generic not yet implemented";
-  int n = ctx.degree();
+typedef void (*system_rows_fn)(nmod_mat_t, nmod_mat_t, int, int, int, 
+    const NTRUKeyGen&, const RotationGather&, bool);
+
+template <class Ring>
+system_rows_fn select_system_rows(int d, RotationGather& gather, int n) {
+  rotation_gather<Ring>(gather, n, d);
+  if (d == 2) {
+    return system_rows<Ring, 2>;
+  } else if (d == 3) {
+    return system_rows<Ring, 3>;
+  }
+  return system_rows<Ring, 0>;
+}
+
+// Pick the builder for the ring and number of coefficients once, outside 
+// of any loop over rows, and set up its rotation gather map.
+system_rows_fn select_system_rows(const NTRUKeyGen& ctx, RotationGather& gather) {
+  int r = ctx.ring();
   int d = ctx.coeffs();
-  int q = ctx.q();
-  int nkeys = nmod_mat_nrows(H_mat);
-  nmod_t q_nmod = ctx.q_nmod();
-  std::vector<int> monomial_coeffs(d);
-  for (int i = 1; i <= d; i++) {
-    monomial_coeffs[i-1] = factorial(d, i);
+  int n = ctx.degree();
+  if (r == 1) {
+    return select_system_rows<Cyclic>(d, gather, n);
+  } else if (r == 2) {
+    return select_system_rows<Negacyclic>(d, gather, n);
   }
-  
-  int m = n + d - 1;
-  std::vector<bool> perm(m);
-  std::fill(perm.begin(), perm.begin() + d, true);
-
-  // Iterate over unique monomials.
-  int i, j, k, x, idx, n_unique;
-  std::vector<int> comb(d);
-  std::vector<std::vector<int>> combs;
-  std::vector<int> unique;
-
-  // precompute combinations:
-  do {
-    idx = 0;
-    n_unique = 0;
-    for (i = 0; i < m; ++i) {
-      if (perm[i]) {
-        comb[idx] = i - idx;
-        if (idx > 0 && comb[idx-1] == comb[idx]) {
-          n_unique++;
-        }
-        idx++;
+  return select_system_rows<SparseModulus>(d, gather, n);
+}
+
+}
+
+SystemBuilder::SystemBuilder(const NTRUKeyGen& keygen, bool fold) 
+  : keygen_(keygen), fold_(fold) {
+  this->rows_ = select_system_rows(keygen, this->gather_);
+}
+
+void SystemBuilder::rows(nmod_mat_t block, nmod_mat_t H_mat, int key, 
+    int start, int end) const {
+  this->rows_(block, H_mat, key, start, end, this->keygen_, this->gather_, 
+      this->fold_);
+}
+
+void arora_ge_system(nmod_mat_t res, nmod_mat_t H_mat, const NTRUKeyGen& keygen,
+    int nthreads, bool fold) {
+  SystemBuilder builder(keygen, fold);
+  arora_ge_system(res, H_mat, builder, nthreads);
+}
+
+void arora_ge_system(nmod_mat_t res, nmod_mat_t H_mat, 
+    const SystemBuilder& builder, int nthreads) {
+  const NTRUKeyGen& keygen = builder.keygen();
+  set_log_level(keygen.log_level());
+
+  int n = keygen.degree();
+  int nkeys = nmod_mat_nrows(H_mat);
+  int ncols = nmod_mat_ncols(res);
+
+  // Split each key into enough ranges of rotations that every thread has 
+  // work. Each task writes its own band of rows of res, so the result does 
+  // not depend on how tasks are scheduled.
+  nthreads = std::max(1, nthreads);
+  int splits = std::min(n, (nthreads + nkeys - 1) / std::max(1, nkeys));
+  int chunk = (n + splits - 1) / splits;
+  int ntasks = nkeys * splits;
+  std::atomic<int> next(0);
+
+  auto worker = [&]() {
+    nmod_mat_t window;
+    int t;
+    while ((t = next++) < ntasks) {
+      int i = t / splits;
+      int start = (t % splits) * chunk;
+      int end = std::min(n, start + chunk);
+      if (start >= end) {
+        continue;
       }
+      nmod_mat_window_init(window, res, n*i + start, 0, n*i + end, ncols);
+      builder.rows(window, H_mat, i, start, end);
+      nmod_mat_window_clear(window);
     }
-    combs.push_back(comb);
-    unique.push_back(n_unique);
-  } while (std::prev_permutation(perm.begin(), perm.end()));
+  };
 
-  nmod_mat_t mult, window;
-  nmod_mat_init(mult, n, n, q);
-  nmod_poly_t hi, hij, xj, x1;
-  nmod_poly_init_mod(hi, q_nmod);
-  nmod_poly_init_mod(hij, q_nmod);
-  nmod_poly_init_mod(xj, q_nmod);
-  nmod_poly_init_mod(x1, q_nmod);
-  // for each i
-  for (i = 0; i < nkeys; i++) {
-    // make multiplication matrix for each h_i
-    for (j = 0; j < n; j++) {
-      x = nmod_mat_get_entry(H_mat, i, j);
-      nmod_poly_set_coeff_ui(hi, j, x);
-    }
-    nmod_poly_set_coeff_ui(x1, 1, 1);
-    nmod_poly_zero (xj);
-    nmod_poly_set_coeff_ui(xj, 0, 1);
-    for (j = 0; j < n; j++) {
-      nmod_poly_mul(hij, hi, xj);
-      nmod_poly_rem(hij, hij, ctx.modulus);
-      for (k = 0; k < n; k++) {
-        x = nmod_poly_get_coeff_ui (hij, k);
-        nmod_mat_set_entry (mult, k, j, x);
-      }
-      nmod_poly_mul(xj, xj, x1);
+  std::vector<std::thread> threads;
+  for (int i = 1; i < std::min(nthreads, ntasks); i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+
+void multiplication_matrix_ntru(nmod_mat_t mult, nmod_mat_t H_mat, int key, 
+    const NTRUKeyGen& ctx) {
+  int n = ctx.degree();
+
+  int j, k, x;
+  for (j = 0; j < n; j++) {
+    x = nmod_mat_get_entry(H_mat, key, j);
+    for (k = 0; k < n; k++) {
+      nmod_mat_set_entry(mult, k, (k-j+n) % n, x);
     }
-    // set first block to negative of multiplication matrix
-    nmod_mat_window_init(window, res, n*i, 0, n*i+n, n);
-    nmod_mat_neg(window, mult);
-    nmod_mat_window_clear(window);
-    for (j = 0; j < n; j++) {
-      nmod_mat_window_init(window, mult, j, 0, j+1, n);
-      for (size_t k = 0; k < combs.size(); k++) {
-        comb = combs[k];
-        n_unique = unique[k];
-        x = power_product(window, comb);
-        x = nmod_mul(monomial_coeffs[n_unique], x, q_nmod);
-        nmod_mat_set_entry(res, n*i + j, n + k, x);
-      }
-      nmod_mat_window_clear(window);
+  }
+}
+
+void multiplication_matrix_ntru2(nmod_mat_t mult, nmod_mat_t H_mat, int key, 
+    const NTRUKeyGen& ctx) {
+  int n = ctx.degree();
+  nmod_t q_nmod = ctx.q_nmod();
+
+  int j, k, x, y;
+  for (j = 0; j < n; j++) {
+    x = nmod_mat_get_entry(H_mat, key, j);
+    for (k = 0; k < j; k++) {
+      y = nmod_neg(x, q_nmod);
+      nmod_mat_set_entry(mult, k, (k-j+n) % n, y);
+    }      
+    for (k = j; k < n; k++) {
+      nmod_mat_set_entry(mult, k, (k-j+n) % n, x);
     }
   }
-  nmod_mat_clear(mult);
-  nmod_poly_clear(hi);
-  nmod_poly_clear(hij);
-  nmod_poly_clear(xj);
-  nmod_poly_clear(x1);
+}
+
+void multiplication_matrix_generic(nmod_mat_t mult, nmod_mat_t H_mat, int key, 
+    const NTRUKeyGen& ctx) {
+  int n = ctx.degree();
+
+  nmod_poly_t h;
+  nmod_poly_init_mod(h, ctx.q_nmod());
+  for (int j = 0; j < n; j++) {
+    nmod_poly_set_coeff_ui(h, j, nmod_mat_get_entry(H_mat, key, j));
+  }
+  multiplication_matrix(mult, h, ctx);
+  nmod_poly_clear(h);
 }
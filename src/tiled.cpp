@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <flint.h>
+#include <nmod.h>
+#include <nmod_mat.h>
+
+#include "tiled.hpp"
+#include "system.hpp"
+#include "extras.hpp"
+#include "logging.hpp"
+
+namespace {
+
+// Tile t of the file, mapped with the offset rounded down to a page.
+class TileMapping {
+  void * base_;
+  size_t length_;
+  mp_limb_t * data_;
+
+  public:
+    TileMapping(int fd, off_t offset, size_t bytes, bool write) {
+      off_t page = sysconf(_SC_PAGE_SIZE);
+      off_t start = offset - offset % page;
+      this->length_ = bytes + (offset - start);
+      int prot = write ? PROT_READ | PROT_WRITE : PROT_READ;
+      this->base_ = mmap(nullptr, this->length_, prot, MAP_SHARED, fd, start);
+      if (this->base_ == MAP_FAILED) {
+        throw "Cannot map tile";
+      }
+      this->data_ = (mp_limb_t *) ((char *) this->base_ + (offset - start));
+    }
+    ~TileMapping() { munmap(this->base_, this->length_); }
+
+    mp_limb_t * data() const { return data_; }
+};
+
+}
+
+TiledMatrix::TiledMatrix(const std::string& path, slong nrows, slong ncols,
+    slong rows_per_tile, mp_limb_t q) {
+  assert(nrows >= 0 && ncols > 0 && rows_per_tile > 0);
+  this->path_ = path;
+  this->nrows_ = nrows;
+  this->ncols_ = ncols;
+  this->rows_per_tile_ = rows_per_tile;
+  this->q_ = q;
+
+  this->fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (this->fd_ < 0) {
+    throw "Cannot create tile file";
+  }
+  if (ftruncate(this->fd_, nrows*ncols*sizeof(mp_limb_t)) != 0) {
+    close(this->fd_);
+    throw "Cannot allocate tile file";
+  }
+}
+
+TiledMatrix::~TiledMatrix() {
+  close(this->fd_);
+  unlink(this->path_.c_str());
+}
+
+slong TiledMatrix::tile_rows(slong t) const {
+  return std::min(this->rows_per_tile_, this->nrows_ - t*this->rows_per_tile_);
+}
+
+void TiledMatrix::load(nmod_mat_t mat, slong t) const {
+  slong nrows = this->tile_rows(t);
+  slong ncols = this->ncols_;
+  assert(nmod_mat_nrows(mat) == nrows && nmod_mat_ncols(mat) == ncols);
+  TileMapping tile(this->fd_, t*this->rows_per_tile_*ncols*sizeof(mp_limb_t),
+      nrows*ncols*sizeof(mp_limb_t), false);
+  const mp_limb_t * data = tile.data();
+  for (slong i = 0; i < nrows; i++) {
+    for (slong j = 0; j < ncols; j++) {
+      nmod_mat_entry(mat, i, j) = data[i*ncols + j];
+    }
+  }
+}
+
+void TiledMatrix::store(slong t, nmod_mat_t mat) {
+  slong nrows = this->tile_rows(t);
+  slong ncols = this->ncols_;
+  assert(nmod_mat_nrows(mat) == nrows && nmod_mat_ncols(mat) == ncols);
+  TileMapping tile(this->fd_, t*this->rows_per_tile_*ncols*sizeof(mp_limb_t),
+      nrows*ncols*sizeof(mp_limb_t), true);
+  mp_limb_t * data = tile.data();
+  for (slong i = 0; i < nrows; i++) {
+    for (slong j = 0; j < ncols; j++) {
+      data[i*ncols + j] = nmod_mat_entry(mat, i, j);
+    }
+  }
+}
+
+slong tiled_rows_per_tile(slong ncols, slong memory) {
+  return std::max((slong) 1, memory / (4*ncols*(slong) sizeof(mp_limb_t)));
+}
+
+void tiled_stream_shape(std::istream& is, slong& nrows, slong& ncols) {
+  char c;
+  std::string line;
+  nrows = 0;
+  ncols = 0;
+
+  is >> c;
+  if (c != '[') {
+    throw "Invalid matrix";
+  }
+  while (is >> c && c == '[') {
+    std::getline(is, line);
+    if (nrows == 0) {
+      ncols = parse_line(line).size();
+    }
+    nrows++;
+  }
+}
+
+void tiled_from_stream(TiledMatrix& res, std::istream& is) {
+  char c;
+  std::string line;
+  slong ncols = res.ncols();
+
+  is >> c;
+  if (c != '[') {
+    throw "Invalid matrix";
+  }
+  nmod_mat_t tile;
+  for (slong t = 0; t < res.ntiles(); t++) {
+    nmod_mat_init(tile, res.tile_rows(t), ncols, res.q());
+    for (slong i = 0; i < res.tile_rows(t); i++) {
+      if (!(is >> c) || c != '[') {
+        throw "Invalid matrix";
+      }
+      std::getline(is, line);
+      auto row = parse_line(line);
+      for (slong j = 0; j < ncols; j++) {
+        nmod_mat_entry(tile, i, j) = std::stoul(row[j]) % res.q();
+      }
+    }
+    res.store(t, tile);
+    nmod_mat_clear(tile);
+  }
+}
+
+void arora_ge_system_tiled(TiledMatrix& res, nmod_mat_t H_mat,
+    const NTRUKeyGen& keygen, bool fold) {
+  int n = keygen.degree();
+  assert(res.nrows() == n*nmod_mat_nrows(H_mat));
+  assert((ulong) res.ncols() == num_variables(n, keygen.coeffs(), fold));
+
+  // a tile may start and end in the middle of a key's rows
+  SystemBuilder builder(keygen, fold);
+  nmod_mat_t tile, window;
+  for (slong t = 0; t < res.ntiles(); t++) {
+    slong first = t*res.rows_per_tile();
+    slong last = first + res.tile_rows(t);
+    nmod_mat_init(tile, res.tile_rows(t), res.ncols(), res.q());
+    for (slong row = first; row < last; ) {
+      int key = row / n;
+      int start = row - key*n;
+      int end = std::min((slong) n, last - key*n);
+      nmod_mat_window_init(window, tile, row - first, 0,
+          row - first + end - start, res.ncols());
+      builder.rows(window, H_mat, key, start, end);
+      nmod_mat_window_clear(window);
+      row += end - start;
+    }
+    res.store(t, tile);
+    nmod_mat_clear(tile);
+  }
+}
+
+slong arora_ge_nullspace_tiled(nmod_mat_t X, TiledMatrix& system) {
+  slong ncols = system.ncols();
+  slong ntiles = system.ntiles();
+  mp_limb_t q = system.q();
+  assert(nmod_mat_nrows(X) == ncols);
+
+  // pivots[t] are the pivot columns of the rows of tile t, which are the
+  // first pivots[t].size() rows after elimination
+  std::vector<std::vector<slong>> pivots(ntiles);
+  nmod_mat_t P, E, R, Ej;
+  for (slong k = 0; k < ntiles; k++) {
+    nmod_mat_init(P, system.tile_rows(k), ncols, q);
+    system.load(P, k);
+
+    for (slong j = 0; j < k; j++) {
+      if (pivots[j].empty()) {
+        continue;
+      }
+      nmod_mat_init(E, system.tile_rows(j), ncols, q);
+      system.load(E, j);
+      nmod_mat_window_init(Ej, E, 0, 0, pivots[j].size(), ncols);
+      nmod_mat_reduce_pivots(P, pivots[j], Ej);
+      nmod_mat_window_clear(Ej);
+      nmod_mat_clear(E);
+    }
+
+    slong rank = nmod_mat_rref(P);
+    for (slong i = 0; i < rank; i++) {
+      slong c = 0;
+      while (nmod_mat_entry(P, i, c) == 0) {
+        c++;
+      }
+      pivots[k].push_back(c);
+    }
+
+    // keep the earlier rows reduced at the new pivots
+    if (rank > 0) {
+      nmod_mat_window_init(R, P, 0, 0, rank, ncols);
+      for (slong j = 0; j < k; j++) {
+        if (pivots[j].empty()) {
+          continue;
+        }
+        nmod_mat_init(E, system.tile_rows(j), ncols, q);
+        system.load(E, j);
+        nmod_mat_window_init(Ej, E, 0, 0, pivots[j].size(), ncols);
+        if (nmod_mat_reduce_pivots(Ej, pivots[k], R)) {
+          system.store(j, E);
+        }
+        nmod_mat_window_clear(Ej);
+        nmod_mat_clear(E);
+      }
+      nmod_mat_window_clear(R);
+    }
+    system.store(k, P);
+    nmod_mat_clear(P);
+
+    slong done = k + 1;
+    debug("Eliminated tile ", done, " of ", ntiles, "\n");
+  }
+
+  // one kernel vector for each non-pivot column, as in nmod_mat_nullspace
+  std::vector<uint8_t> is_pivot(ncols, 0);
+  for (slong t = 0; t < ntiles; t++) {
+    for (slong c : pivots[t]) {
+      is_pivot[c] = 1;
+    }
+  }
+  std::vector<slong> nonpivot;
+  for (slong c = 0; c < ncols; c++) {
+    if (!is_pivot[c]) {
+      nonpivot.push_back(c);
+    }
+  }
+  slong nullity = nonpivot.size();
+  slong m = std::min(nullity, (slong) nmod_mat_ncols(X));
+
+  nmod_mat_zero(X);
+  for (slong l = 0; l < m; l++) {
+    nmod_mat_entry(X, nonpivot[l], l) = 1;
+  }
+  for (slong t = 0; t < ntiles; t++) {
+    if (pivots[t].empty()) {
+      continue;
+    }
+    nmod_mat_init(E, system.tile_rows(t), ncols, q);
+    system.load(E, t);
+    for (size_t i = 0; i < pivots[t].size(); i++) {
+      for (slong l = 0; l < m; l++) {
+        nmod_mat_entry(X, pivots[t][i], l) =
+          nmod_neg(nmod_mat_entry(E, i, nonpivot[l]), X->mod);
+      }
+    }
+    nmod_mat_clear(E);
+  }
+  return nullity;
+}
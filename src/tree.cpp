@@ -0,0 +1,144 @@
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include <flint.h>
+#include <nmod.h>
+#include <nmod_mat.h>
+
+#include "tree.hpp"
+#include "system.hpp"
+#include "scheduler.hpp"
+#include "extras.hpp"
+#include "logging.hpp"
+
+namespace {
+
+// Rows in rref among themselves, row i with its pivot in column pivots[i].
+struct Echelon {
+  nmod_mat_t rows;
+  std::vector<slong> pivots;
+};
+
+// Reduce the rows of E to rref and drop the zero rows.
+void echelon_reduce(Echelon& E) {
+  slong rank = nmod_mat_rref(E.rows);
+  for (slong i = 0; i < rank; i++) {
+    slong c = 0;
+    while (nmod_mat_entry(E.rows, i, c) == 0) {
+      c++;
+    }
+    E.pivots.push_back(c);
+  }
+
+  nmod_mat_t window, temp;
+  nmod_mat_window_init(window, E.rows, 0, 0, rank, nmod_mat_ncols(E.rows));
+  nmod_mat_init_set(temp, window);
+  nmod_mat_window_clear(window);
+  nmod_mat_swap(E.rows, temp);
+  nmod_mat_clear(temp);
+}
+
+// Merge B into A and clear B. The rows of B are reduced by the pivots of A
+// and then to rref, and those of A by the new pivots.
+void echelon_merge(Echelon& A, Echelon& B) {
+  if (!A.pivots.empty() && !B.pivots.empty()) {
+    nmod_mat_reduce_pivots(B.rows, A.pivots, A.rows);
+    B.pivots.clear();
+    echelon_reduce(B);
+    if (!B.pivots.empty()) {
+      nmod_mat_reduce_pivots(A.rows, B.pivots, B.rows);
+    }
+  }
+
+  if (A.pivots.empty()) {
+    nmod_mat_swap(A.rows, B.rows);
+    A.pivots.swap(B.pivots);
+  } else if (!B.pivots.empty()) {
+    nmod_mat_t temp;
+    nmod_mat_init(temp, nmod_mat_nrows(A.rows) + nmod_mat_nrows(B.rows),
+        nmod_mat_ncols(A.rows), A.rows->mod.n);
+    nmod_mat_concat_vertical(temp, A.rows, B.rows);
+    nmod_mat_swap(A.rows, temp);
+    nmod_mat_clear(temp);
+    A.pivots.insert(A.pivots.end(), B.pivots.begin(), B.pivots.end());
+  }
+  nmod_mat_clear(B.rows);
+}
+
+}
+
+int arora_ge_nullspace_tree(nmod_mat_t X, slong& rank, nmod_mat_t H_mat,
+    const NTRUKeyGen& ctx, slong cap, int nthreads, bool fold) {
+  set_log_level(ctx.log_level());
+
+  int n = ctx.degree();
+  slong nkeys = nmod_mat_nrows(H_mat);
+  slong ncols = num_variables(n, ctx.coeffs(), fold);
+  mp_limb_t q = ctx.q();
+  assert(nkeys > 0);
+
+  if (ncols - n*nkeys > cap) {
+    rank = ncols - n*nkeys;
+    nmod_mat_init(X, ncols, 0, q);
+    return 1;
+  }
+
+  // task[i] is the last task writing node i; node i absorbs node i + width
+  // at the level of that width
+  std::vector<Echelon> nodes(nkeys);
+  std::vector<size_t> task(nkeys);
+  TaskGraph graph;
+  SystemBuilder builder(ctx, fold);
+  for (slong key = 0; key < nkeys; key++) {
+    task[key] = graph.add([&, key]() {
+      nmod_mat_init(nodes[key].rows, n, ncols, q);
+      builder.rows(nodes[key].rows, H_mat, key, 0, n);
+      echelon_reduce(nodes[key]);
+    });
+  }
+  for (slong width = 1; width < nkeys; width *= 2) {
+    for (slong i = 0; i + width < nkeys; i += 2*width) {
+      size_t t = graph.add([&, i, width]() {
+        echelon_merge(nodes[i], nodes[i + width]);
+      });
+      graph.depend(t, task[i]);
+      graph.depend(t, task[i + width]);
+      task[i] = t;
+    }
+  }
+  graph.run(nthreads);
+
+  Echelon& E = nodes[0];
+  slong r = E.pivots.size();
+  rank = ncols - r;
+  debug("Merged ", nkeys, " echelon forms to rank ", r, "\n");
+  if (rank > cap) {
+    nmod_mat_clear(E.rows);
+    nmod_mat_init(X, ncols, 0, q);
+    return 1;
+  }
+
+  // one kernel vector for each non-pivot column, as in nmod_mat_nullspace
+  std::vector<uint8_t> is_pivot(ncols, 0);
+  for (slong c : E.pivots) {
+    is_pivot[c] = 1;
+  }
+  std::vector<slong> nonpivot;
+  for (slong c = 0; c < ncols; c++) {
+    if (!is_pivot[c]) {
+      nonpivot.push_back(c);
+    }
+  }
+
+  nmod_mat_init(X, ncols, rank, q);
+  for (slong l = 0; l < rank; l++) {
+    nmod_mat_entry(X, nonpivot[l], l) = 1;
+    for (slong i = 0; i < r; i++) {
+      nmod_mat_entry(X, E.pivots[i], l) =
+        nmod_neg(nmod_mat_entry(E.rows, i, nonpivot[l]), X->mod);
+    }
+  }
+  nmod_mat_clear(E.rows);
+  return 0;
+}